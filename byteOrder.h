@@ -0,0 +1,41 @@
+//
+// Header for the byte order helpers (decoding the little and big endian numbers of on-disk structures)
+//
+
+#ifndef OS_TERM_PROJECT_BYTEORDER_H
+#define OS_TERM_PROJECT_BYTEORDER_H
+
+#include <cstdint>
+#include <stdexcept>
+
+// converts the given character buffer from little endian to a single uint64_t ('size' = length of buffer)
+// note: 'size' should never be greater than 8
+inline uint64_t littleEndianToInt(const char *buffer, uint8_t size) {
+  // input error checking
+  if (size > 8) {
+    throw std::invalid_argument("'size' should never be greater than 8");
+  }
+
+  uint64_t result = 0;
+  for (uint8_t i = size; i > 0; --i) {
+    result = (result << 8) | static_cast<uint8_t>(buffer[i - 1]);
+  }
+  return result;
+}
+
+// converts the given character buffer from big endian to a single uint64_t ('size' = length of buffer)
+// note: 'size' should never be greater than 8
+inline uint64_t bigEndianToInt(const char *buffer, uint8_t size) {
+  // input error checking
+  if (size > 8) {
+    throw std::invalid_argument("'size' should never be greater than 8");
+  }
+
+  uint64_t result = 0;
+  for (uint8_t i = 0; i < size; ++i) {
+    result = (result << 8) | static_cast<uint8_t>(buffer[i]);
+  }
+  return result;
+}
+
+#endif  // OS_TERM_PROJECT_BYTEORDER_H
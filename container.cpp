@@ -0,0 +1,82 @@
+//
+// Implementation of the disk image container class (maps virtual disk bytes to bytes of the image file)
+//
+
+#include "container.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "byteOrder.h"
+#include "qcow2Container.h"
+#include "vdiContainer.h"
+#include "vmdkContainer.h"
+
+// constructor that takes the reader for the image file and its size in bytes
+container::container(fileReader reader, uint64_t fileSize) : readFile(std::move(reader)), fileBytes(fileSize) {}
+
+// throws if the 'length' bytes starting at byte 'diskPosition' are not all inside the virtual disk
+void container::checkRange(uint64_t diskPosition, uint32_t length) const {
+  if (diskPosition > diskBytes || length > diskBytes - diskPosition) {
+    throw std::out_of_range("cannot read, the requested range is outside of the virtual disk");
+  }
+}
+
+// throws if the 'length' bytes starting at byte 'filePosition' are not all inside the image file (a damaged or
+// truncated image whose tables point past its end)
+void container::checkFileRange(uint64_t filePosition, uint32_t length) const {
+  if (filePosition > fileBytes || length > fileBytes - filePosition) {
+    throw std::runtime_error("corrupt " + std::string(format()) + " image, data is mapped past the end of the file");
+  }
+}
+
+// get the size of the virtual disk in bytes
+uint64_t container::diskSize() const { return diskBytes; }
+
+// get the size of the virtual disk's sectors in bytes
+uint32_t container::sectorSize() const { return sectorBytes; }
+
+// pick the container for an image file by the magic number in its first bytes (raw if none matches)
+// ('reader' and 'fileSize' are handed to the chosen container)
+std::unique_ptr<container> container::open(const fileReader &reader, uint64_t fileSize) {
+  // enough of the file to hold every format's magic number (VDI keeps its signature at 0x40)
+  char magic[0x44] = {};
+  if (fileSize >= sizeof(magic)) {
+    reader(magic, 0, sizeof(magic));
+  }
+
+  if (littleEndianToInt(magic + 0x40, 4) == 0xbeda107f) {
+    return std::unique_ptr<container>(new vdiContainer(reader, fileSize));
+  }
+
+  if (memcmp(magic, "QFI\xfb", 4) == 0) {
+    return std::unique_ptr<container>(new qcow2Container(reader, fileSize));
+  }
+
+  if (memcmp(magic, "KDMV", 4) == 0) {
+    return std::unique_ptr<container>(new vmdkContainer(reader, fileSize));
+  }
+
+  // a VMDK descriptor file only points to the extent files that hold the data
+  if (memcmp(magic, "# Disk DescriptorFile", 21) == 0) {
+    throw std::runtime_error("VMDK descriptor files are not supported, open the monolithic sparse VMDK file instead");
+  }
+
+  return std::unique_ptr<container>(new rawContainer(reader, fileSize));
+}
+
+// constructor that takes the reader for the image file and its size in bytes
+rawContainer::rawContainer(fileReader reader, uint64_t fileSize) : container(std::move(reader), fileSize) {
+  diskBytes = fileSize;
+}
+
+// find where byte 'diskPosition' of the virtual disk is stored in the image file (always at the same position)
+bool rawContainer::locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) {
+  checkRange(diskPosition, length);
+  filePosition = diskPosition;
+  return true;
+}
+
+// get the name of the image format
+const char *rawContainer::format() const { return "raw"; }
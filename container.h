@@ -0,0 +1,98 @@
+//
+// Header for the disk image container class (maps virtual disk bytes to bytes of the image file)
+//
+
+#ifndef OS_TERM_PROJECT_CONTAINER_H
+#define OS_TERM_PROJECT_CONTAINER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class container {
+ public:
+  /* VARIABLES */
+
+  // reads 'size' bytes starting at byte 'position' of the image file into 'buffer' (throws if it cannot)
+  // note: must be safe to call from multiple threads at once
+  typedef std::function<void(char *buffer, uint64_t position, uint32_t size)> fileReader;
+
+ protected:
+  /* VARIABLES */
+
+  // reads from the image file
+  fileReader readFile;
+
+  // size of the image file in bytes
+  uint64_t fileBytes;
+
+  // size of the virtual disk in bytes
+  uint64_t diskBytes = 0;
+
+  // size of the virtual disk's sectors in bytes
+  uint32_t sectorBytes = 512;
+
+  /* METHODS */
+
+  // throws if the 'length' bytes starting at byte 'diskPosition' are not all inside the virtual disk
+  void checkRange(uint64_t diskPosition, uint32_t length) const;
+
+  // throws if the 'length' bytes starting at byte 'filePosition' are not all inside the image file (a damaged or
+  // truncated image whose tables point past its end)
+  void checkFileRange(uint64_t filePosition, uint32_t length) const;
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the reader for the image file and its size in bytes
+  container(fileReader reader, uint64_t fileSize);
+
+  // a container describes one open image file
+  container(const container &) = delete;
+  container &operator=(const container &) = delete;
+
+  /* DESTRUCTOR */
+
+  virtual ~container() = default;
+
+  /* METHODS */
+
+  // find where byte 'diskPosition' of the virtual disk is stored in the image file ('filePosition')
+  // 'length' is cut down to the number of bytes that are stored contiguously from there (or that are all unallocated)
+  // returns true on success, false if those bytes are not allocated in the image (they read back as zeros)
+  // note: safe to call from multiple threads at once (lookup tables are loaded on first use and cached)
+  virtual bool locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) = 0;
+
+  // get the name of the image format
+  virtual const char *format() const = 0;
+
+  // get the size of the virtual disk in bytes
+  uint64_t diskSize() const;
+
+  // get the size of the virtual disk's sectors in bytes
+  uint32_t sectorSize() const;
+
+  // pick the container for an image file by the magic number in its first bytes (raw if none matches)
+  // ('reader' and 'fileSize' are handed to the chosen container)
+  static std::unique_ptr<container> open(const fileReader &reader, uint64_t fileSize);
+};
+
+// a raw disk image (the file holds every byte of the disk in order, e.g. '.img' files made with dd)
+class rawContainer : public container {
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the reader for the image file and its size in bytes
+  rawContainer(fileReader reader, uint64_t fileSize);
+
+  /* METHODS */
+
+  // find where byte 'diskPosition' of the virtual disk is stored in the image file (always at the same position)
+  bool locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) override;
+
+  // get the name of the image format
+  const char *format() const override;
+};
+
+#endif  // OS_TERM_PROJECT_CONTAINER_H
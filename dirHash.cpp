@@ -0,0 +1,169 @@
+//
+// Implementation of the directory hash class (the name hashes of ext3/ext4 HTree indexed directories)
+//
+
+#include "dirHash.h"
+
+#include <stdexcept>
+#include <string>
+
+// rotate the 32-bit word 'x' left by 's' bits
+static inline uint32_t rotateLeft(uint32_t x, int s) { return (x << s) | (x >> (32 - s)); }
+
+// the original ext3 hash
+uint32_t dirHash::legacyHash(const char *name, size_t len, bool unsignedChars) {
+  uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+  for (size_t i = 0; i < len; ++i) {
+    int c = unsignedChars ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+    hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+    if (hash & 0x80000000) {
+      hash -= 0x7fffffff;
+    }
+    hash1 = hash0;
+    hash0 = hash;
+  }
+
+  return hash0 << 1;
+}
+
+// pack up to 'num' * 4 bytes of the name into 'num' words (the rest is padded with the name's length)
+void dirHash::packName(const char *name, size_t len, uint32_t *words, int num, bool unsignedChars) {
+  uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+  pad |= pad << 16;
+
+  uint32_t value = pad;
+  if (len > (size_t)num * 4) {
+    len = num * 4;
+  }
+
+  for (size_t i = 0; i < len; ++i) {
+    int c = unsignedChars ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+    value = (uint32_t)c + (value << 8);
+    if (i % 4 == 3) {
+      *words++ = value;
+      value = pad;
+      --num;
+    }
+  }
+
+  if (--num >= 0) {
+    *words++ = value;
+  }
+  while (--num >= 0) {
+    *words++ = pad;
+  }
+}
+
+// one round of the half MD4 transform over 8 words of the name
+void dirHash::halfMD4Transform(uint32_t buf[4], const uint32_t in[8]) {
+  const uint32_t k2 = 013240474631UL, k3 = 015666365641UL;
+  uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  auto f = [](uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); };
+  auto g = [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) + ((x ^ y) & z); };
+  auto h = [](uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; };
+
+  // round 1
+  a = rotateLeft(a + f(b, c, d) + in[0], 3);
+  d = rotateLeft(d + f(a, b, c) + in[1], 7);
+  c = rotateLeft(c + f(d, a, b) + in[2], 11);
+  b = rotateLeft(b + f(c, d, a) + in[3], 19);
+  a = rotateLeft(a + f(b, c, d) + in[4], 3);
+  d = rotateLeft(d + f(a, b, c) + in[5], 7);
+  c = rotateLeft(c + f(d, a, b) + in[6], 11);
+  b = rotateLeft(b + f(c, d, a) + in[7], 19);
+
+  // round 2
+  a = rotateLeft(a + g(b, c, d) + in[1] + k2, 3);
+  d = rotateLeft(d + g(a, b, c) + in[3] + k2, 5);
+  c = rotateLeft(c + g(d, a, b) + in[5] + k2, 9);
+  b = rotateLeft(b + g(c, d, a) + in[7] + k2, 13);
+  a = rotateLeft(a + g(b, c, d) + in[0] + k2, 3);
+  d = rotateLeft(d + g(a, b, c) + in[2] + k2, 5);
+  c = rotateLeft(c + g(d, a, b) + in[4] + k2, 9);
+  b = rotateLeft(b + g(c, d, a) + in[6] + k2, 13);
+
+  // round 3
+  a = rotateLeft(a + h(b, c, d) + in[3] + k3, 3);
+  d = rotateLeft(d + h(a, b, c) + in[7] + k3, 9);
+  c = rotateLeft(c + h(d, a, b) + in[2] + k3, 11);
+  b = rotateLeft(b + h(c, d, a) + in[6] + k3, 15);
+  a = rotateLeft(a + h(b, c, d) + in[1] + k3, 3);
+  d = rotateLeft(d + h(a, b, c) + in[5] + k3, 9);
+  c = rotateLeft(c + h(d, a, b) + in[0] + k3, 11);
+  b = rotateLeft(b + h(c, d, a) + in[4] + k3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+// one round of the TEA transform over 4 words of the name
+void dirHash::teaTransform(uint32_t buf[4], const uint32_t in[4]) {
+  uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+
+  for (int n = 0; n < 16; ++n) {
+    sum += 0x9e3779b9;
+    b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+    b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+  }
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+// checks if 'hashVersion' is one of the versions this class can compute (true = supported)
+bool dirHash::supported(uint8_t hashVersion) { return hashVersion <= teaUnsigned; }
+
+// get the major hash of the name 'name' of length 'len' the way the kernel computes it for an indexed directory
+// ('seed' is the filesystem's hash seed, all zeros = the default seed, the lowest bit of the result is always 0)
+uint32_t dirHash::hash(const char *name, size_t len, uint8_t hashVersion, const uint32_t seed[4]) {
+  // the MD4 starting values unless the filesystem has its own seed
+  uint32_t buf[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  if (seed[0] | seed[1] | seed[2] | seed[3]) {
+    for (int i = 0; i < 4; ++i) {
+      buf[i] = seed[i];
+    }
+  }
+
+  bool unsignedChars = hashVersion >= legacyUnsigned;
+  uint32_t in[8];
+  uint32_t result;
+
+  switch (hashVersion) {
+    case legacy:
+    case legacyUnsigned:
+      result = legacyHash(name, len, unsignedChars);
+      break;
+    case halfMD4:
+    case halfMD4Unsigned:
+      // 32 bytes of the name per round
+      for (size_t done = 0; done < len; done += 32) {
+        packName(name + done, len - done, in, 8, unsignedChars);
+        halfMD4Transform(buf, in);
+      }
+      result = buf[1];
+      break;
+    case tea:
+    case teaUnsigned:
+      // 16 bytes of the name per round
+      for (size_t done = 0; done < len; done += 16) {
+        packName(name + done, len - done, in, 4, unsignedChars);
+        teaTransform(buf, in);
+      }
+      result = buf[0];
+      break;
+    default:
+      throw std::invalid_argument("unsupported directory hash version: " + std::to_string(hashVersion));
+  }
+
+  // the lowest bit marks hash collisions that continue in the next block, the largest value is reserved for the end
+  result &= ~1u;
+  if (result == 0x7fffffffu << 1) {
+    result = (0x7fffffffu - 1) << 1;
+  }
+
+  return result;
+}
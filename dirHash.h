@@ -0,0 +1,45 @@
+//
+// Header for the directory hash class (the name hashes of ext3/ext4 HTree indexed directories)
+//
+
+#ifndef OS_TERM_PROJECT_DIRHASH_H
+#define OS_TERM_PROJECT_DIRHASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+class dirHash {
+ public:
+  /* VARIABLES */
+
+  // hash versions an indexed directory can use (stored in its dx_root, the unsigned variants treat the bytes of the
+  // name as unsigned chars, the others as signed chars)
+  enum version : uint8_t { legacy = 0, halfMD4 = 1, tea = 2, legacyUnsigned = 3, halfMD4Unsigned = 4, teaUnsigned = 5 };
+
+ private:
+  /* METHODS */
+
+  // the original ext3 hash
+  static uint32_t legacyHash(const char *name, size_t len, bool unsignedChars);
+
+  // pack up to 'num' * 4 bytes of the name into 'num' words (the rest is padded with the name's length)
+  static void packName(const char *name, size_t len, uint32_t *words, int num, bool unsignedChars);
+
+  // one round of the half MD4 transform over 8 words of the name
+  static void halfMD4Transform(uint32_t buf[4], const uint32_t in[8]);
+
+  // one round of the TEA transform over 4 words of the name
+  static void teaTransform(uint32_t buf[4], const uint32_t in[4]);
+
+ public:
+  /* METHODS */
+
+  // checks if 'hashVersion' is one of the versions this class can compute (true = supported)
+  static bool supported(uint8_t hashVersion);
+
+  // get the major hash of the name 'name' of length 'len' the way the kernel computes it for an indexed directory
+  // ('seed' is the filesystem's hash seed, all zeros = the default seed, the lowest bit of the result is always 0)
+  static uint32_t hash(const char *name, size_t len, uint8_t hashVersion, const uint32_t seed[4]);
+};
+
+#endif  // OS_TERM_PROJECT_DIRHASH_H
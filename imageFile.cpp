@@ -0,0 +1,126 @@
+//
+// Implementation of the image file class (one opened disk image file, shared by every vdi handle on its partitions)
+//
+
+#include "imageFile.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// constructor that opens the image file at 'filePath' (and memory-maps all of it if 'mapped' is true)
+imageFile::imageFile(const char *filePath, bool mapped) {
+#ifdef _WIN32
+  // no positional reads or memory mappings, everything goes through one stream
+  if (mapped) {
+    throw std::runtime_error("the mmap backend is not supported on Windows");
+  }
+
+  stream.open(filePath, std::ios::in | std::ios::binary);
+  if (!stream) {
+    throw std::runtime_error("cannot open VDI file: " + std::string(filePath));
+  }
+
+  // get file size
+  stream.seekg(0, std::ios::end);
+  fileSize = stream.tellg();
+  stream.clear();
+#else
+  // open a read-only descriptor for the positional reads (and the memory mapping)
+  fd = open(filePath, O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open VDI file: " + std::string(filePath));
+  }
+
+  // get file size
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("cannot get the size of the VDI file: " + std::string(filePath));
+  }
+  fileSize = st.st_size;
+
+  // map the whole file into memory when requested
+  if (mapped) {
+    // a 32-bit process cannot map a file of 4 GiB or more, use the stream backend for those
+    if (fileSize == 0 || fileSize > std::numeric_limits<size_t>::max()) {
+      close(fd);
+      throw std::runtime_error("the VDI file is empty or too large to memory-map on this system");
+    }
+
+    // create the mapping
+    void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("cannot memory-map the VDI file");
+    }
+    mappedFile = static_cast<const char *>(mapping);
+  }
+#endif
+}
+
+// releases the memory mapping and the descriptor
+imageFile::~imageFile() {
+#ifndef _WIN32
+  if (mappedFile != NULL) {
+    munmap(const_cast<char *>(mappedFile), fileSize);
+  }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+#endif
+}
+
+// read 'size' bytes starting at byte 'position' of the image file into buffer
+// note: safe to call from multiple threads at once
+void imageFile::read(char *buffer, uint64_t position, uint32_t size) {
+  // check that the requested bytes are inside the file
+  if (position > fileSize || size > fileSize - position) {
+    throw std::out_of_range("cannot read, the requested range is outside of the VDI file");
+  }
+
+  if (mappedFile != NULL) {
+    // copy straight out of the mapping
+    memcpy(buffer, mappedFile + position, size);
+    return;
+  }
+
+#ifdef _WIN32
+  // no positional reads available, move the shared cursor (one thread at a time)
+  std::lock_guard<std::mutex> lock(streamMutex);
+  stream.seekg(position);
+  stream.read(buffer, size);
+  if (stream.gcount() != size) {
+    stream.clear();
+    throw std::runtime_error("cannot read, the requested range is outside of the VDI file");
+  }
+#else
+  // 'pread' may return less than requested, keep reading until everything has arrived
+  while (size > 0) {
+    ssize_t count = pread(fd, buffer, size, position);
+    if (count <= 0) {
+      throw std::runtime_error("cannot read, the requested range is outside of the VDI file");
+    }
+    buffer += count;
+    position += count;
+    size -= count;
+  }
+#endif
+}
+
+// get the size of the image file in bytes
+uint64_t imageFile::size() const { return fileSize; }
+
+// get the read-only descriptor of the image file (-1 on Windows)
+int imageFile::descriptor() const { return fd; }
+
+// get the start of the memory mapping of the whole image file (NULL = not memory-mapped)
+const char *imageFile::mapping() const { return mappedFile; }
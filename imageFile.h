@@ -0,0 +1,61 @@
+//
+// Header for the image file class (one opened disk image file, shared by every vdi handle on its partitions)
+//
+
+#ifndef OS_TERM_PROJECT_IMAGEFILE_H
+#define OS_TERM_PROJECT_IMAGEFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+class imageFile {
+ private:
+  /* VARIABLES */
+
+  // size of the image file in bytes
+  uint64_t fileSize = 0;
+
+  // read-only descriptor of the image file used for positional reads (-1 = not opened)
+  int fd = -1;
+
+  // start of the read-only memory mapping of the whole image file (NULL = not memory-mapped)
+  const char *mappedFile = NULL;
+
+  // the image file read through a stream on platforms without positional reads, guarded by 'streamMutex'
+  std::ifstream stream;
+  std::mutex streamMutex;
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that opens the image file at 'filePath' (and memory-maps all of it if 'mapped' is true)
+  imageFile(const char *filePath, bool mapped);
+
+  // copying would share the descriptor and the memory mapping between two owners
+  imageFile(const imageFile &) = delete;
+  imageFile &operator=(const imageFile &) = delete;
+
+  /* DESTRUCTOR */
+
+  // releases the memory mapping and the descriptor
+  ~imageFile();
+
+  /* METHODS */
+
+  // read 'size' bytes starting at byte 'position' of the image file into buffer
+  // note: safe to call from multiple threads at once
+  void read(char *buffer, uint64_t position, uint32_t size);
+
+  // get the size of the image file in bytes
+  uint64_t size() const;
+
+  // get the read-only descriptor of the image file (-1 on Windows)
+  int descriptor() const;
+
+  // get the start of the memory mapping of the whole image file (NULL = not memory-mapped)
+  const char *mapping() const;
+};
+
+#endif  // OS_TERM_PROJECT_IMAGEFILE_H
@@ -0,0 +1,141 @@
+//
+// Header for the LRU cache template (thread-safe, fixed number of entries)
+//
+
+#ifndef OS_TERM_PROJECT_LRUCACHE_H
+#define OS_TERM_PROJECT_LRUCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class lruCache {
+ private:
+  /* VARIABLES */
+
+  // cached entries ordered from most recently used (front) to least recently used (back)
+  std::list<std::pair<Key, Value>> entries;
+
+  // lookup from a key to its place in 'entries'
+  std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index;
+
+  // maximum number of entries held at once (0 = caching disabled)
+  size_t maxEntries;
+
+  // number of lookups that found / did not find their key
+  uint64_t hitCount = 0, missCount = 0;
+
+  // guards every member above so one cache can be shared by many threads
+  mutable std::mutex lock;
+
+  /* METHODS */
+
+  // drop least recently used entries until there are at most 'maxEntries' left (lock must be held)
+  void trim() {
+    while (entries.size() > maxEntries) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the maximum number of entries
+  explicit lruCache(size_t capacity) : maxEntries(capacity) {}
+
+  /* METHODS */
+
+  // copy the value cached under 'key' into 'value' and mark it as most recently used
+  // returns true on a hit, false if 'key' is not cached
+  bool get(const Key &key, Value &value) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto found = index.find(key);
+    if (found == index.end()) {
+      ++missCount;
+      return false;
+    }
+
+    // move the entry to the front of the list
+    entries.splice(entries.begin(), entries, found->second);
+    value = found->second->second;
+    ++hitCount;
+
+    return true;
+  }
+
+  // cache 'value' under 'key' (replacing any existing value), evicting the least recently used entry if full
+  void put(const Key &key, const Value &value) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (maxEntries == 0) {
+      return;
+    }
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+      // already cached, update in place and move to the front
+      found->second->second = value;
+      entries.splice(entries.begin(), entries, found->second);
+      return;
+    }
+
+    entries.emplace_front(key, value);
+    index[key] = entries.begin();
+    trim();
+  }
+
+  // mark the entry cached under 'key' as most recently used without copying it out (not counted as a lookup)
+  // returns true if 'key' is cached
+  bool touch(const Key &key) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto found = index.find(key);
+    if (found == index.end()) {
+      return false;
+    }
+
+    entries.splice(entries.begin(), entries, found->second);
+    return true;
+  }
+
+  // change the maximum number of entries (0 disables caching and empties the cache)
+  void setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> guard(lock);
+    maxEntries = capacity;
+    trim();
+  }
+
+  // get the maximum number of entries
+  size_t capacity() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return maxEntries;
+  }
+
+  // get the number of lookups that found their key
+  uint64_t hits() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return hitCount;
+  }
+
+  // get the number of lookups that did not find their key
+  uint64_t misses() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return missCount;
+  }
+
+  // remove every entry (the hit and miss counts are kept)
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    index.clear();
+    entries.clear();
+  }
+};
+
+#endif  // OS_TERM_PROJECT_LRUCACHE_H
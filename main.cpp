@@ -1,63 +1,457 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
-
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "pathIndex.h"
+#include "threadPool.h"
 #include "vdi.h"
 
-int main(int argc, char **argv) {
-  if (argc != 4) {
-    throw std::invalid_argument(
-        "program needs 3 arguments in this order:\n"
-        "path to VDI file, path to a file within the VDI, output file to write to on the host system");
+// warn that the filesystem read by 'file' still has a journal to replay (its recent changes are not in the metadata)
+static void warnIfNeedsRecovery(const vdi &file) {
+  if (file.needsRecovery()) {
+    std::cerr << "warning: the filesystem of partition " << file.partitionNumber()
+              << " was not cleanly unmounted and its journal is not replayed, recently changed files may be read "
+                 "from stale metadata\n";
   }
+}
 
-  // open VDI file passed to the program as an argument
-  vdi file = vdi(argv[1]);
+// map the path index at 'indexPath' for the VDI file at 'imagePath', (re)building it first if it is missing or out of
+// date
+static std::unique_ptr<pathIndex> openIndex(vdi &file, const char *imagePath, const char *indexPath) {
+  std::unique_ptr<pathIndex> index(new pathIndex(indexPath, imagePath, file.partitionNumber()));
+  if (!index->valid()) {
+    std::cout << "building path index \"" << indexPath << "\"\n";
+    pathIndex::build(file, imagePath, indexPath);
+    index.reset(new pathIndex(indexPath, imagePath, file.partitionNumber()));
+  }
 
-  // open the file to write out to
-  std::ofstream out;
-  out.open(argv[3], std::ios::out | std::ios::trunc | std::ios::binary);
+  return index;
+}
 
-  // show status message to user
-  std::cout << "copying file \"" << argv[2] << "\" from VDI to host system as \"" << argv[3] << "\"\n";
+// copy the file at 'path' inside the VDI to 'hostPath' on the host system
+// (the path is resolved through 'index' when one is given, otherwise by walking the directories)
+static void extractOne(vdi &file, const pathIndex *index, const std::string &path, const char *hostPath) {
+  if (index != NULL) {
+    // find the file without touching any directories
+    pathIndex::entry found{};
+    if (!index->lookup(path.c_str(), found)) {
+      throw std::runtime_error("file not found inside the VDI: " + path);
+    }
 
-  // get inode number of desired file
-  uint32_t iNum = file.traversePath(argv[2]);
+    // only regular files have data to copy (directories and symlinks have no extents in the index)
+    if (found.fileType != 1 || (found.mode & 0xF000) != 0x8000) {
+      throw std::runtime_error("not a regular file inside the VDI: " + path);
+    }
 
-  // get inode
-  vdi::inode in{};
-  file.fetchInode(in, iNum);
+    // copy the file over one contiguous run of blocks at a time
+    file.extractRuns(found.extents, found.extentCount, found.size, hostPath);
+  } else {
+    // get inode number of desired file ('traversePath' writes into the path, so it gets its own copy)
+    std::vector<char> pathCopy(path.begin(), path.end());
+    pathCopy.push_back('\0');
+    uint32_t iNum = file.traversePath(pathCopy.data());
+    if (iNum == 0) {
+      throw std::runtime_error("file not found inside the VDI: " + path);
+    }
+
+    // get inode
+    vdi::inode in{};
+    file.fetchInode(in, iNum);
+
+    // only regular files are copied (the same check as the index lookup above)
+    if ((in.mode & 0xF000) != 0x8000) {
+      throw std::runtime_error("not a regular file inside the VDI: " + path);
+    }
 
-  // calculate how many blocks the file takes up
-  uint32_t blockCount = in.size / file.superblock.blockSize + 1;
+    // copy the file over one contiguous run of blocks at a time
+    file.extractFile(in, hostPath);
+  }
+}
 
-  // calculate the remaining number of bytes in the final block
-  uint32_t remainder = in.size % file.superblock.blockSize;
+// extract every file listed in the manifest at 'manifestPath' using 'threadCount' worker threads
+// (each line of the manifest is a path inside the VDI and a path on the host system separated by a tab,
+// empty lines and lines starting with '#' are skipped)
+// returns the number of files that could not be extracted
+static size_t extractBatch(vdi &file, const pathIndex *index, const char *manifestPath, unsigned threadCount) {
+  // open the manifest
+  std::ifstream manifest(manifestPath);
+  if (!manifest) {
+    throw std::runtime_error("cannot open manifest: " + std::string(manifestPath));
+  }
 
-  // buffer for holding each block of data
-  char buffer[file.superblock.blockSize];
+  // read every (path inside the VDI, path on the host system) pair
+  std::vector<std::pair<std::string, std::string>> jobs;
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(manifest, line); ++lineNumber) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
 
-  // loop through the file block by block
-  for (uint32_t i = 0; i < blockCount; ++i) {
-    // read current block into buffer
-    file.fetchBlockFromFile(buffer, in, i);
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      throw std::invalid_argument("manifest line " + std::to_string(lineNumber) +
+                                  " needs a path inside the VDI and a host path separated by a tab");
+    }
+    jobs.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+  }
+
+  // the files that failed and why (filled in by the workers)
+  std::vector<std::string> failures;
+  std::mutex failuresLock;
+
+  // hand every file to the worker pool (the VDI is opened once and shared by all workers)
+  threadPool pool(threadCount);
+  std::cout << "copying " << jobs.size() << " files from VDI to host system using " << pool.size() << " threads\n";
+  for (const auto &job : jobs) {
+    pool.submit([&file, index, &job, &failures, &failuresLock] {
+      try {
+        extractOne(file, index, job.first, job.second.c_str());
+      } catch (const std::exception &e) {
+        // one bad entry should not stop the rest of the batch
+        std::lock_guard<std::mutex> guard(failuresLock);
+        failures.push_back(job.first + " (" + e.what() + ")");
+      }
+    });
+  }
+  pool.wait();
+
+  // show the results to the user
+  for (const std::string &failure : failures) {
+    std::cerr << "failed to copy " << failure << '\n';
+  }
+  std::cout << jobs.size() - failures.size() << " files copied, " << failures.size() << " failed\n";
+
+  return failures.size();
+}
+
+// structure of a file found while walking a directory tree for extraction
+struct treeFile {
+  std::string hostPath;
+  uint64_t size;
+  uint32_t firstBlock;
+  std::vector<vdi::extent> runs;
+};
+
+// create the directory 'hostPath' on the host system (an existing directory is fine)
+static void makeHostDir(const std::string &hostPath) {
+#ifdef _WIN32
+  int result = _mkdir(hostPath.c_str());
+#else
+  int result = mkdir(hostPath.c_str(), 0755);
+#endif
+  if (result != 0 && errno != EEXIST) {
+    throw std::runtime_error("cannot create directory: " + hostPath);
+  }
+}
+
+// recreate every directory below the directory with inode 'iNum' under 'hostDir' and add every regular file below it
+// to 'files' (other entries like symlinks and devices are counted in 'skipped')
+static void collectTree(vdi &file, uint32_t iNum, std::string hostDir, std::vector<treeFile> &files, size_t &skipped) {
+  // 'hostDir' follows the walk down into every folder and back up
+  vdi::treeVisitor visitor;
+
+  // folders are created right away so every file has somewhere to go
+  visitor.preDir = [&hostDir](const vdi::dirEntryView &dir, uint32_t) {
+    hostDir += '/' + std::string(dir.name, dir.nameLen);
+    makeHostDir(hostDir);
+    return true;
+  };
+  visitor.postDir = [&hostDir](const vdi::dirEntryView &, uint32_t) { hostDir.resize(hostDir.rfind('/')); };
+
+  visitor.file = [&file, &hostDir, &files, &skipped](const vdi::dirEntryView &entry, uint32_t) {
+    if (entry.fileType != 1) {
+      ++skipped;
+      return;
+    }
+
+    vdi::inode in{};
+    file.fetchInode(in, entry.iNum);
+
+    treeFile found{hostDir + '/' + std::string(entry.name, entry.nameLen), in.size, 0, file.mapFile(in)};
+
+    // files are ordered by the first block that actually holds data (holes have no place on the disk)
+    for (const vdi::extent &run : found.runs) {
+      if (run.physical != 0) {
+        found.firstBlock = run.physical;
+        break;
+      }
+    }
+    files.push_back(std::move(found));
+  };
+
+  file.visitTree(iNum, visitor);
+}
 
-    // if the loop is on the final block
-    if (i == blockCount - 1 && remainder != 0) {
-      // write only the remaining bytes, not the entire block
-      out.write(buffer, remainder);
+// copy the directory at 'path' inside the VDI and everything below it to 'hostDir' on the host system using
+// 'threadCount' worker threads
+// (files are copied in order of their first block on the disk so the reads stay close to sequential)
+// returns the number of files that could not be extracted
+static size_t extractTree(vdi &file, const std::string &path, const char *hostDir, unsigned threadCount) {
+  // get inode number of the desired directory ('traversePath' writes into the path, so it gets its own copy)
+  std::vector<char> pathCopy(path.begin(), path.end());
+  pathCopy.push_back('\0');
+  uint32_t iNum = file.traversePath(pathCopy.data());
+
+  vdi::inode in{};
+  if (iNum != 0) {
+    file.fetchInode(in, iNum);
+  }
+  if (iNum == 0 || (in.mode & 0xF000) != 0x4000) {
+    throw std::runtime_error("directory not found inside the VDI: " + path);
+  }
+
+  // recreate the folders and find every file to copy
+  std::vector<treeFile> files;
+  size_t skipped = 0;
+  makeHostDir(hostDir);
+  collectTree(file, iNum, hostDir, files, skipped);
+
+  std::sort(files.begin(), files.end(),
+            [](const treeFile &a, const treeFile &b) { return a.firstBlock < b.firstBlock; });
+
+  // the files that failed and why (filled in by the workers)
+  std::vector<std::string> failures;
+  std::mutex failuresLock;
+
+  // each worker gets a contiguous stretch of the disk, idle workers steal from the end of the others' stretches
+  threadPool pool(threadCount);
+  std::cout << "copying " << files.size() << " files from VDI to host system using " << pool.size() << " threads\n";
+
+  std::vector<std::function<void()>> tasks;
+  for (const treeFile &f : files) {
+    tasks.push_back([&file, &f, &failures, &failuresLock] {
+      try {
+        file.extractRuns(f.runs.data(), f.runs.size(), f.size, f.hostPath.c_str());
+      } catch (const std::exception &e) {
+        // one bad file should not stop the rest of the tree
+        std::lock_guard<std::mutex> guard(failuresLock);
+        failures.push_back(f.hostPath + " (" + e.what() + ")");
+      }
+    });
+  }
+  pool.submitOrdered(std::move(tasks));
+  pool.wait();
+
+  // show the results to the user
+  for (const std::string &failure : failures) {
+    std::cerr << "failed to copy " << failure << '\n';
+  }
+  std::cout << files.size() - failures.size() << " files copied, " << failures.size() << " failed";
+  if (skipped != 0) {
+    std::cout << ", " << skipped << " special files skipped";
+  }
+  std::cout << '\n';
+
+  return failures.size();
+}
+
+int main(int argc, char **argv) {
+  // storage backend to read the VDI file through (changed with the "--mmap" option)
+  vdi::ioBackend backend = vdi::ioBackend::stream;
+
+  // path of the sidecar path index to resolve paths with (changed with the "--index" option, NULL = no index)
+  const char *indexPath = NULL;
+
+  // path of the manifest to extract in batch mode (changed with the "--batch" option, NULL = single file mode)
+  const char *manifestPath = NULL;
+
+  // extract a whole directory tree instead of a single file (changed with the "--tree" option)
+  bool treeMode = false;
+
+  // read the inodes for the listing with a sequential scan of the inode tables (changed with the "--scan" option)
+  bool scanMode = false;
+
+  // number and size (in MiB) of the buffers of the pipelined copy (changed with the "--pipeline" and "--buffer-size"
+  // options, 0 buffers = the kernel copies the data)
+  unsigned pipelineBuffers = 0, pipelineBufferSize = 8;
+  const unsigned long maxPipelineBuffers = 64;
+
+  // number of reads kept in flight at once (changed with the "--queue-depth" option, 0 = one synchronous read at a time)
+  unsigned queueDepth = 0;
+
+  // number of the partition whose filesystem is read (changed with the "--partition" option, 1 based, MBR or GPT order)
+  int partition = 1;
+
+  // also list the files of every other partition after the listing (changed with the "--all-partitions" option)
+  bool allPartitions = false;
+
+  // number of worker threads used by batch mode, tree mode and the listing (changed with the "--threads" option,
+  // 0 = one per hardware thread)
+  unsigned threadCount = 0;
+  const unsigned long maxThreads = 1024;
+
+  // the positional arguments (everything that is not an option)
+  std::vector<char *> args;
+
+  // separate the options from the positional arguments
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--mmap") == 0) {
+      backend = vdi::ioBackend::mmap;
+    } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+      indexPath = argv[++i];
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      manifestPath = argv[++i];
+    } else if (strcmp(argv[i], "--tree") == 0) {
+      treeMode = true;
+    } else if (strcmp(argv[i], "--scan") == 0) {
+      scanMode = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+      // checked before narrowing, every buffer is allocated up front
+      unsigned long buffers = std::stoul(argv[++i]);
+      if (buffers > maxPipelineBuffers) {
+        throw std::invalid_argument("--pipeline must be between 0 and " + std::to_string(maxPipelineBuffers) +
+                                    " buffers, received: " + std::string(argv[i]));
+      }
+      pipelineBuffers = buffers;
+    } else if (strcmp(argv[i], "--buffer-size") == 0 && i + 1 < argc) {
+      // the size is passed on in bytes as a 32-bit number (checked before narrowing, so large values cannot wrap)
+      unsigned long megabytes = std::stoul(argv[++i]);
+      if (megabytes == 0 || megabytes > (UINT32_MAX >> 20)) {
+        throw std::invalid_argument("--buffer-size must be between 1 and " + std::to_string(UINT32_MAX >> 20) +
+                                    " MiB, received: " + std::string(argv[i]));
+      }
+      pipelineBufferSize = megabytes;
+    } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+      // checked before narrowing, the kernel refuses deeper io_uring instances
+      unsigned long depth = std::stoul(argv[++i]);
+      if (depth == 0 || depth > readEngine::maxQueueDepth) {
+        throw std::invalid_argument("--queue-depth must be between 1 and " + std::to_string(readEngine::maxQueueDepth) +
+                                    ", received: " + std::string(argv[i]));
+      }
+      queueDepth = depth;
+    } else if (strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+      partition = std::stoi(argv[++i]);
+    } else if (strcmp(argv[i], "--all-partitions") == 0) {
+      allPartitions = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      // checked before narrowing, every thread is started up front
+      unsigned long threads = std::stoul(argv[++i]);
+      if (threads > maxThreads) {
+        throw std::invalid_argument("--threads must be between 0 and " + std::to_string(maxThreads) +
+                                    ", received: " + std::string(argv[i]));
+      }
+      threadCount = threads;
     } else {
-      // not on the final block (or the file takes up exactly the final block)
-      // write the entire block
-      out.write(buffer, file.superblock.blockSize);
+      args.push_back(argv[i]);
     }
   }
 
+  // batch and tree mode extract without the listing, and tree mode walks the directories instead of resolving paths
+  if (manifestPath != NULL && treeMode) {
+    throw std::invalid_argument("--batch and --tree cannot be used together");
+  }
+  if (treeMode && indexPath != NULL) {
+    throw std::invalid_argument("--index cannot be used with --tree (the tree is walked directory by directory)");
+  }
+  if ((manifestPath != NULL || treeMode) && (scanMode || allPartitions)) {
+    throw std::invalid_argument("--scan and --all-partitions only apply to the listing, which --batch and --tree skip");
+  }
+
+  if (args.size() != (manifestPath != NULL ? 1 : 3)) {
+    throw std::invalid_argument(
+        "program needs 3 arguments in this order:\n"
+        "path to VDI file, path to a file within the VDI, output file to write to on the host system\n"
+        "(in batch mode only the path to the VDI file is needed, in tree mode the paths are directories)\n"
+        "(qcow2, monolithic sparse VMDK and raw disk images are read the same way as VDI files)\n"
+        "options:\n"
+        "--mmap\t\tmemory-map the VDI file instead of reading it through a file stream\n"
+        "--index FILE\tresolve paths through the sidecar path index FILE (built on the first run)\n"
+        "--batch FILE\textract every file listed in the manifest FILE (one \"VDI path<tab>host path\" per line)\n"
+        "--tree\t\textract a directory inside the VDI and everything below it to a directory on the host system\n"
+        "--scan\t\tread the inodes for the file listing with one sequential pass over the inode tables\n"
+        "--pipeline N\tcopy file data through N buffers read and written by two threads at once\n"
+        "--buffer-size MIB\tsize of each pipeline buffer in MiB (default: 8)\n"
+        "--queue-depth N\tkeep up to N reads in flight at once (io_uring where available, else worker threads)\n"
+        "--partition N\tread the filesystem of partition N (MBR or GPT, default: 1)\n"
+        "--all-partitions\tafter the listing, also list the files of every other partition with an ext2/3/4 filesystem\n"
+        "--threads N\tnumber of worker threads used by batch mode, tree mode and the listing (default: one per hardware "
+        "thread)");
+  }
+
+  // open VDI file passed to the program as an argument
+  vdi file(args[0], backend, partition);
+  warnIfNeedsRecovery(file);
+
+  // set up the pipelined copy if one was requested
+  file.setExtractPipeline(pipelineBuffers, pipelineBufferSize << 20);
+
+  // keep several reads in flight at once if requested
+  file.setQueueDepth(queueDepth);
+
+  // map (or build) the path index if one was requested
+  std::unique_ptr<pathIndex> index;
+  if (indexPath != NULL) {
+    index = openIndex(file, args[0], indexPath);
+  }
+
+  // batch mode extracts the whole manifest and exits
+  if (manifestPath != NULL) {
+    return extractBatch(file, index.get(), manifestPath, threadCount) == 0 ? 0 : 1;
+  }
+
+  // tree mode extracts the whole directory and exits
+  if (treeMode) {
+    return extractTree(file, args[1], args[2], threadCount) == 0 ? 0 : 1;
+  }
+
+  // show status message to user
+  std::cout << "copying file \"" << args[1] << "\" from VDI to host system as \"" << args[2] << "\"\n";
+
+  // copy the file
+  extractOne(file, index.get(), args[1], args[2]);
+
   // show status messages to user
   std::cout << "file finished copying\n";
   std::cout << "now printing all files and folders inside the VDI file:\n\n";
 
-  // print all files
-  file.printAllFiles(2);
+  // print all files of the filesystem read by 'filesystem'
+  auto printFiles = [scanMode, threadCount](vdi &filesystem) {
+    if (scanMode) {
+      // read every inode table front to back first, then join the inodes with the directory entries
+      vdi::inodeSet inodes;
+      filesystem.scanInodes(inodes);
+      filesystem.printAllFiles(2, inodes);
+    } else {
+      // the directories are read in parallel, the output is in the usual order
+      filesystem.printAllFiles(2, threadCount);
+    }
+  };
+  printFiles(file);
+
+  // print the files of the other partitions (each handle reads the image already opened by 'file')
+  if (allPartitions) {
+    for (size_t other = 1; other <= file.partitionTable.size(); ++other) {
+      if ((int)other == partition || file.partitionTable[other - 1].LBA_sector_count == 0) {
+        continue;
+      }
+
+      // partitions without an ext2/3/4 filesystem (swap, FAT, ...) are skipped
+      std::unique_ptr<vdi> otherFile;
+      try {
+        otherFile.reset(new vdi(file, other));
+      } catch (const std::exception &e) {
+        std::cerr << "skipping partition " << other << ": " << e.what() << '\n';
+        continue;
+      }
+
+      warnIfNeedsRecovery(*otherFile);
+      std::cout << "\nnow printing all files and folders inside partition " << other << ":\n\n";
+      printFiles(*otherFile);
+    }
+  }
 
   /* TESTING BELOW THIS LINE */
 
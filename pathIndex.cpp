@@ -0,0 +1,267 @@
+//
+// Implementation of the sidecar path index class
+//
+
+#include "pathIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// identifies an index file (the last character is the format version)
+static const char indexMagic[8] = {'V', 'D', 'I', 'P', 'I', 'D', 'X', '2'};
+
+// version of the index file format
+static const uint32_t indexVersion = 2;
+
+// structure of a file or directory collected while building an index
+struct pendingEntry {
+  std::string path;
+  uint64_t size;
+  uint32_t iNum, mtime;
+  uint16_t mode;
+  uint8_t fileType;
+  std::vector<vdi::extent> runs;
+};
+
+// adds every entry below the directory with inode 'iNum' (whose full path is 'prefix') to 'entries'
+static void collectEntries(vdi &image, uint32_t iNum, std::string prefix, std::vector<pendingEntry> &entries) {
+  // fill out the collected entry of a file or folder inside the directory at 'prefix'
+  auto collect = [&image, &prefix, &entries](const vdi::dirEntryView &entry) {
+    vdi::inode in{};
+    image.fetchInode(in, entry.iNum);
+
+    pendingEntry collected;
+    collected.path = prefix + '/' + std::string(entry.name, entry.nameLen);
+    collected.size = in.size;
+    collected.iNum = entry.iNum;
+    collected.mtime = in.mtime;
+    collected.mode = in.mode;
+    collected.fileType = entry.fileType;
+
+    // only regular files have data runs (symlinks may keep their target inside the block array)
+    if (entry.fileType == 1) {
+      collected.runs = image.mapFile(in);
+    }
+
+    entries.push_back(std::move(collected));
+  };
+
+  // 'prefix' follows the walk down into every folder and back up
+  vdi::treeVisitor visitor;
+  visitor.preDir = [&collect, &prefix, &entries](const vdi::dirEntryView &dir, uint32_t) {
+    collect(dir);
+    prefix = entries.back().path;
+    return true;
+  };
+  visitor.postDir = [&prefix](const vdi::dirEntryView &, uint32_t) { prefix.resize(prefix.rfind('/')); };
+  visitor.file = [&collect](const vdi::dirEntryView &file, uint32_t) { collect(file); };
+
+  image.visitTree(iNum, visitor);
+}
+
+// gets the size and modification time of the VDI file that an index is keyed to
+void pathIndex::imageStamp(const char *imagePath, uint64_t &size, int64_t &mtimeSec, int64_t &mtimeNsec) {
+#ifdef _WIN32
+  throw std::runtime_error("path indexes are not supported on Windows");
+#else
+  struct stat st {};
+  if (stat(imagePath, &st) != 0) {
+    throw std::runtime_error("cannot get the size and modification time of: " + std::string(imagePath));
+  }
+
+  size = st.st_size;
+  mtimeSec = st.st_mtim.tv_sec;
+  mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+}
+
+// constructor that maps the index at 'indexPath' if it exists and was built from partition 'partition' of the VDI file
+// at 'imagePath' (an index that is missing, damaged, older than the VDI file or of another partition is ignored, see
+// 'valid')
+pathIndex::pathIndex(const char *indexPath, const char *imagePath, int partition) {
+#ifndef _WIN32
+  // a missing index is not an error, it just needs to be built
+  int fd = open(indexPath, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  // the mapping covers the entire index file
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(fileHeader)) {
+    close(fd);
+    return;
+  }
+  mappedSize = st.st_size;
+
+  // create the mapping (it stays valid after the handle is closed)
+  void *mapping = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mappedSize = 0;
+    return;
+  }
+  mappedFile = static_cast<const char *>(mapping);
+
+  // check that the index is an index of this exact VDI file and partition
+  const fileHeader *candidate = reinterpret_cast<const fileHeader *>(mappedFile);
+  uint64_t imageSize;
+  int64_t imageMtimeSec, imageMtimeNsec;
+  imageStamp(imagePath, imageSize, imageMtimeSec, imageMtimeNsec);
+
+  bool matches = memcmp(candidate->magic, indexMagic, sizeof(indexMagic)) == 0 &&
+                 candidate->version == indexVersion && candidate->partition == (uint32_t)partition &&
+                 candidate->imageSize == imageSize &&
+                 candidate->imageMtimeSec == imageMtimeSec && candidate->imageMtimeNsec == imageMtimeNsec;
+
+  // check that the sections are where the header says they are
+  matches = matches &&
+            candidate->extentsOffset == sizeof(fileHeader) + (uint64_t)candidate->entryCount * sizeof(record) &&
+            candidate->namesOffset >= candidate->extentsOffset && candidate->namesOffset <= mappedSize &&
+            (candidate->namesOffset - candidate->extentsOffset) % sizeof(vdi::extent) == 0;
+
+  // check that every record points inside the name and extent sections (a truncated or damaged index would otherwise
+  // be read past its end by 'lookup' and the copy of its runs)
+  if (matches) {
+    const record *candidateRecords = reinterpret_cast<const record *>(mappedFile + sizeof(fileHeader));
+    uint64_t extentCount = (candidate->namesOffset - candidate->extentsOffset) / sizeof(vdi::extent);
+    uint64_t namesSize = mappedSize - candidate->namesOffset;
+
+    for (uint32_t i = 0; i < candidate->entryCount && matches; ++i) {
+      const record &r = candidateRecords[i];
+      matches = r.nameOffset <= namesSize && r.nameLen <= namesSize - r.nameOffset && r.extentStart <= extentCount &&
+                r.extentCount <= extentCount - r.extentStart;
+    }
+  }
+
+  if (!matches) {
+    return;
+  }
+
+  // index is usable
+  header = candidate;
+  records = reinterpret_cast<const record *>(mappedFile + sizeof(fileHeader));
+  extents = reinterpret_cast<const vdi::extent *>(mappedFile + header->extentsOffset);
+  names = mappedFile + header->namesOffset;
+#endif
+}
+
+// releases the memory mapping
+pathIndex::~pathIndex() {
+#ifndef _WIN32
+  if (mappedFile != NULL) {
+    munmap(const_cast<char *>(mappedFile), mappedSize);
+  }
+#endif
+}
+
+// walks every file and directory of 'image' once and writes the index for it to 'indexPath'
+// ('imagePath' is the path 'image' was opened from, the index is keyed to its size and modification time and to the
+// partition 'image' reads)
+void pathIndex::build(vdi &image, const char *imagePath, const char *indexPath) {
+  // collect every entry of the filesystem, starting at the root directory
+  std::vector<pendingEntry> entries;
+  collectEntries(image, 2, "", entries);
+
+  // lookups are binary searches, so the records have to be sorted by path
+  std::sort(entries.begin(), entries.end(),
+            [](const pendingEntry &a, const pendingEntry &b) { return a.path < b.path; });
+
+  // fill out the header (the sections follow each other: records, extents, names)
+  fileHeader head{};
+  memcpy(head.magic, indexMagic, sizeof(indexMagic));
+  head.version = indexVersion;
+  head.entryCount = entries.size();
+  head.partition = image.partitionNumber();
+  imageStamp(imagePath, head.imageSize, head.imageMtimeSec, head.imageMtimeNsec);
+
+  // build the records along with the extent and name sections they point into
+  std::vector<record> recordSection;
+  std::vector<vdi::extent> extentSection;
+  std::string nameSection;
+  for (const pendingEntry &e : entries) {
+    record r{};
+    r.size = e.size;
+    r.nameOffset = nameSection.size();
+    r.extentStart = extentSection.size();
+    r.nameLen = e.path.size();
+    r.iNum = e.iNum;
+    r.mtime = e.mtime;
+    r.extentCount = e.runs.size();
+    r.mode = e.mode;
+    r.fileType = e.fileType;
+    recordSection.push_back(r);
+
+    nameSection += e.path;
+    extentSection.insert(extentSection.end(), e.runs.begin(), e.runs.end());
+  }
+
+  head.extentsOffset = sizeof(fileHeader) + recordSection.size() * sizeof(record);
+  head.namesOffset = head.extentsOffset + extentSection.size() * sizeof(vdi::extent);
+
+  // write everything to a temporary file first so a half written index is never picked up
+  std::string tempPath = std::string(indexPath) + ".tmp";
+  std::ofstream out(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+  out.write(reinterpret_cast<const char *>(&head), sizeof(head));
+  out.write(reinterpret_cast<const char *>(recordSection.data()), recordSection.size() * sizeof(record));
+  out.write(reinterpret_cast<const char *>(extentSection.data()), extentSection.size() * sizeof(vdi::extent));
+  out.write(nameSection.data(), nameSection.size());
+  out.close();
+
+  if (!out) {
+    std::remove(tempPath.c_str());
+    throw std::runtime_error("cannot write path index: " + std::string(indexPath));
+  }
+
+  // swap the finished index into place
+  if (std::rename(tempPath.c_str(), indexPath) != 0) {
+    std::remove(tempPath.c_str());
+    throw std::runtime_error("cannot write path index: " + std::string(indexPath));
+  }
+}
+
+// checks if the index was mapped and matches the VDI file (true = usable)
+bool pathIndex::valid() const { return header != NULL; }
+
+// looks up the full path 'path' (starting with '/') with a binary search and fills out 'result'
+// returns true on success, false if the path is not in the index
+bool pathIndex::lookup(const char *path, pathIndex::entry &result) const {
+  if (!valid()) {
+    return false;
+  }
+
+  // compares a record's path with the target path (same ordering as 'std::string' used when building)
+  std::string target(path);
+  const record *end = records + header->entryCount;
+  const record *found = std::lower_bound(records, end, target, [this](const record &r, const std::string &t) {
+    return t.compare(0, std::string::npos, names + r.nameOffset, r.nameLen) > 0;
+  });
+
+  // not found
+  if (found == end || target.compare(0, std::string::npos, names + found->nameOffset, found->nameLen) != 0) {
+    return false;
+  }
+
+  // fill out the result
+  result.size = found->size;
+  result.iNum = found->iNum;
+  result.mtime = found->mtime;
+  result.extentCount = found->extentCount;
+  result.mode = found->mode;
+  result.fileType = found->fileType;
+  result.extents = extents + found->extentStart;
+
+  return true;
+}
@@ -0,0 +1,94 @@
+//
+// Header for the sidecar path index class
+//
+
+#ifndef OS_TERM_PROJECT_PATHINDEX_H
+#define OS_TERM_PROJECT_PATHINDEX_H
+
+#include <cstdint>
+
+#include "vdi.h"
+
+class pathIndex {
+ private:
+  /* VARIABLES */
+
+  // structure of the index file header
+  struct fileHeader {
+    char magic[8];
+    uint32_t version, entryCount, partition, unused;
+    uint64_t imageSize;
+    int64_t imageMtimeSec, imageMtimeNsec;
+    uint64_t extentsOffset, namesOffset;
+  };
+
+  // structure of a single record in the index file (records are sorted by path)
+  struct record {
+    uint64_t size, nameOffset, extentStart;
+    uint32_t nameLen, iNum, mtime, extentCount;
+    uint16_t mode;
+    uint8_t fileType, unused[5];
+  };
+
+  // start of the read-only memory mapping of the index file (NULL = no usable index)
+  const char *mappedFile = NULL;
+
+  // size of the memory mapping in bytes
+  uint64_t mappedSize = 0;
+
+  // the mapped header, records, extents and path names (only set when the index is usable)
+  const fileHeader *header = NULL;
+  const record *records = NULL;
+  const vdi::extent *extents = NULL;
+  const char *names = NULL;
+
+  /* METHODS */
+
+  // gets the size and modification time of the VDI file that an index is keyed to
+  static void imageStamp(const char *imagePath, uint64_t &size, int64_t &mtimeSec, int64_t &mtimeNsec);
+
+ public:
+  /* VARIABLES */
+
+  // structure of the information stored for a single file
+  // ('extents' points into the mapped index and holds 'extentCount' runs, only files have extents)
+  struct entry {
+    uint64_t size;
+    uint32_t iNum, mtime, extentCount;
+    uint16_t mode;
+    uint8_t fileType;
+    const vdi::extent *extents;
+  };
+
+  /* CONSTRUCTORS */
+
+  // constructor that maps the index at 'indexPath' if it exists and was built from partition 'partition' of the VDI
+  // file at 'imagePath' (an index that is missing, damaged, older than the VDI file or of another partition is ignored,
+  // see 'valid')
+  pathIndex(const char *indexPath, const char *imagePath, int partition = 1);
+
+  // copying would share the memory mapping between two owners
+  pathIndex(const pathIndex &) = delete;
+  pathIndex &operator=(const pathIndex &) = delete;
+
+  /* DESTRUCTOR */
+
+  // releases the memory mapping
+  ~pathIndex();
+
+  /* METHODS */
+
+  // walks every file and directory of 'image' once and writes the index for it to 'indexPath'
+  // ('imagePath' is the path 'image' was opened from, the index is keyed to its size and modification time and to the
+  // partition 'image' reads)
+  static void build(vdi &image, const char *imagePath, const char *indexPath);
+
+  // checks if the index was mapped and matches the VDI file (true = usable)
+  bool valid() const;
+
+  // looks up the full path 'path' (starting with '/') with a binary search and fills out 'result'
+  // returns true on success, false if the path is not in the index
+  bool lookup(const char *path, entry &result) const;
+};
+
+#endif  // OS_TERM_PROJECT_PATHINDEX_H
@@ -0,0 +1,159 @@
+//
+// Implementation of the qcow2 container class (QEMU copy-on-write images, version 2 and 3)
+//
+
+#include "qcow2Container.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "byteOrder.h"
+
+// constructor that takes the reader for the image file and its size in bytes (reads the header and L1 table)
+qcow2Container::qcow2Container(fileReader reader, uint64_t fileSize) : container(std::move(reader), fileSize) {
+  setHeader();
+  diskBytes = header.size;
+}
+
+// sets the values in the header struct and loads the L1 table
+void qcow2Container::setHeader() {
+  // the raw header (version 2 headers end at byte 72, version 3 adds the feature bits)
+  char buffer[80];
+  readFile(buffer, 0, sizeof(buffer));
+
+  // get version
+  header.version = bigEndianToInt(buffer + 4, 4);
+
+  // get backing file offset (0 = no backing file)
+  header.backingFileOffset = bigEndianToInt(buffer + 8, 8);
+
+  // get cluster bits (a cluster is 1 << cluster bits bytes)
+  header.clusterBits = bigEndianToInt(buffer + 20, 4);
+
+  // get virtual disk size
+  header.size = bigEndianToInt(buffer + 24, 8);
+
+  // get encryption method (0 = none)
+  header.cryptMethod = bigEndianToInt(buffer + 32, 4);
+
+  // get L1 table size and offset
+  header.l1Size = bigEndianToInt(buffer + 36, 4);
+  header.l1TableOffset = bigEndianToInt(buffer + 40, 8);
+
+  // get incompatible feature bits (version 3 only)
+  header.incompatibleFeatures = header.version >= 3 ? bigEndianToInt(buffer + 72, 8) : 0;
+
+  // refuse anything that cannot be read by following the L1 and L2 tables of this one file
+  if (header.version != 2 && header.version != 3) {
+    throw std::runtime_error("unsupported qcow2 version: " + std::to_string(header.version));
+  }
+  if (header.clusterBits < 9 || header.clusterBits > 21) {
+    throw std::runtime_error("invalid qcow2 header (cluster size out of range)");
+  }
+  if (header.backingFileOffset != 0) {
+    throw std::runtime_error("qcow2 images with a backing file are not supported");
+  }
+  if (header.cryptMethod != 0) {
+    throw std::runtime_error("encrypted qcow2 images are not supported");
+  }
+  // (bit 0 = dirty and bit 1 = corrupt only concern writers, bit 3 = compression type only compressed clusters)
+  if (header.incompatibleFeatures & ~(uint64_t)0xb) {
+    throw std::runtime_error("qcow2 image uses unsupported features (external data file or extended L2 entries)");
+  }
+
+  clusterSize = (uint64_t)1 << header.clusterBits;
+  l2Entries = clusterSize / 8;
+
+  if (header.l1Size < (header.size + clusterSize * l2Entries - 1) / (clusterSize * l2Entries)) {
+    throw std::runtime_error("invalid qcow2 header (the L1 table does not cover the disk)");
+  }
+
+  // load the whole L1 table in a single read (big endian 8-byte entries)
+  std::vector<char> raw((size_t)header.l1Size * 8);
+  readFile(raw.data(), header.l1TableOffset, raw.size());
+
+  l1Table.resize(header.l1Size);
+  for (uint32_t i = 0; i < header.l1Size; ++i) {
+    l1Table[i] = bigEndianToInt(raw.data() + (size_t)i * 8, 8) & offsetMask;
+  }
+}
+
+// get the L2 table stored at byte 'offset' of the image file out of the L2 cache (read from disk only on a miss)
+std::shared_ptr<const std::vector<uint64_t>> qcow2Container::fetchL2(uint64_t offset) {
+  std::shared_ptr<const std::vector<uint64_t>> table;
+
+  // table was read before
+  if (l2Cache.get(offset, table)) {
+    return table;
+  }
+
+  // read the whole table (one cluster) and decode its entries
+  std::vector<char> raw(clusterSize);
+  readFile(raw.data(), offset, clusterSize);
+
+  auto entries = std::make_shared<std::vector<uint64_t>>(l2Entries);
+  for (uint64_t i = 0; i < l2Entries; ++i) {
+    (*entries)[i] = bigEndianToInt(raw.data() + i * 8, 8);
+  }
+  l2Cache.put(offset, entries);
+
+  return entries;
+}
+
+// get the file offset of the cluster described by the L2 entry 'entry' (0 = unallocated or zeroed)
+uint64_t qcow2Container::clusterOffset(uint64_t entry) const {
+  // bit 62 = compressed cluster (its data would have to be inflated, it cannot be copied or mapped as is)
+  if (entry & ((uint64_t)1 << 62)) {
+    throw std::runtime_error("compressed qcow2 clusters are not supported");
+  }
+
+  // bit 0 = cluster reads as zeros (version 3)
+  if (header.version >= 3 && (entry & 1)) {
+    return 0;
+  }
+
+  return entry & offsetMask;
+}
+
+// find where byte 'diskPosition' of the virtual disk is stored in the image file
+// (runs of clusters under one L2 table that follow each other in the file are returned as one piece)
+bool qcow2Container::locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) {
+  checkRange(diskPosition, length);
+
+  uint64_t cluster = diskPosition >> header.clusterBits;
+  uint64_t offset = diskPosition & (clusterSize - 1);
+  uint64_t l2Index = cluster % l2Entries;
+
+  // no L2 table, nothing under it was ever written
+  uint64_t l2Offset = l1Table[cluster / l2Entries];
+  if (l2Offset == 0) {
+    length = std::min((uint64_t)length, (l2Entries - l2Index) * clusterSize - offset);
+    return false;
+  }
+
+  std::shared_ptr<const std::vector<uint64_t>> table = fetchL2(l2Offset);
+  uint64_t first = clusterOffset((*table)[l2Index]);
+
+  // extend the piece over the following clusters while they are stored right after this one (or are also unallocated)
+  uint64_t span = clusterSize - offset;
+  for (uint64_t next = l2Index + 1; span < length && next < l2Entries; ++next, span += clusterSize) {
+    uint64_t nextOffset = clusterOffset((*table)[next]);
+    if (first == 0 ? nextOffset != 0 : nextOffset != first + (next - l2Index) * clusterSize) {
+      break;
+    }
+  }
+  length = std::min((uint64_t)length, span);
+
+  if (first == 0) {
+    return false;
+  }
+
+  filePosition = first + offset;
+  checkFileRange(filePosition, length);
+  return true;
+}
+
+// get the name of the image format
+const char *qcow2Container::format() const { return "qcow2"; }
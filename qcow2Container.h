@@ -0,0 +1,67 @@
+//
+// Header for the qcow2 container class (QEMU copy-on-write images, version 2 and 3)
+//
+
+#ifndef OS_TERM_PROJECT_QCOW2CONTAINER_H
+#define OS_TERM_PROJECT_QCOW2CONTAINER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "container.h"
+#include "lruCache.h"
+
+class qcow2Container : public container {
+ public:
+  /* VARIABLES */
+
+  // structure of the qcow2 header (the fields needed to read the image)
+  struct header {
+    uint32_t version, clusterBits, cryptMethod, l1Size;
+    uint64_t backingFileOffset, size, l1TableOffset, incompatibleFeatures;
+  } header;
+
+ private:
+  /* VARIABLES */
+
+  // size of a cluster in bytes and the number of entries in one L2 table (one cluster of 8-byte entries)
+  uint64_t clusterSize = 0, l2Entries = 0;
+
+  // the L1 table (file offsets of the L2 tables, 0 = every cluster under that L2 table is unallocated)
+  std::vector<uint64_t> l1Table;
+
+  // recently used L2 tables, keyed by their file offset (loaded on first use)
+  lruCache<uint64_t, std::shared_ptr<const std::vector<uint64_t>>> l2Cache{256};
+
+  // bits 9-55 of an L1 or L2 entry hold a file offset
+  static const uint64_t offsetMask = 0x00fffffffffffe00ULL;
+
+  /* METHODS */
+
+  // sets the values in the header struct and loads the L1 table
+  void setHeader();
+
+  // get the L2 table stored at byte 'offset' of the image file out of the L2 cache (read from disk only on a miss)
+  std::shared_ptr<const std::vector<uint64_t>> fetchL2(uint64_t offset);
+
+  // get the file offset of the cluster described by the L2 entry 'entry' (0 = unallocated or zeroed)
+  uint64_t clusterOffset(uint64_t entry) const;
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the reader for the image file and its size in bytes (reads the header and L1 table)
+  qcow2Container(fileReader reader, uint64_t fileSize);
+
+  /* METHODS */
+
+  // find where byte 'diskPosition' of the virtual disk is stored in the image file
+  // (runs of clusters under one L2 table that follow each other in the file are returned as one piece)
+  bool locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) override;
+
+  // get the name of the image format
+  const char *format() const override;
+};
+
+#endif  // OS_TERM_PROJECT_QCOW2CONTAINER_H
@@ -0,0 +1,378 @@
+//
+// Implementation of the asynchronous read engine class (io_uring, with a thread pool fallback)
+//
+
+#include "readEngine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+// constructor that reads from the descriptor 'fd' with up to 'queueDepth' reads of each batch in flight at once
+// (uses io_uring where the kernel allows it, otherwise one pool of up to 'maxPoolThreads' worker threads)
+readEngine::readEngine(int fd, unsigned queueDepth)
+    : fd(fd), depth(std::min(std::max(1u, queueDepth), maxQueueDepth)) {
+#ifdef _WIN32
+  throw std::runtime_error("the asynchronous read engine is not supported on Windows");
+#else
+  // io_uring can be missing (older kernels, other systems) or blocked (containers), the pool works everywhere
+  std::unique_ptr<lane> first = openLane();
+  ringAvailable = first != nullptr;
+  if (ringAvailable) {
+    idleLanes.push_back(std::move(first));
+  }
+#endif
+}
+
+// releases the io_uring instance and its mappings
+// note: closing the ring neither cancels nor waits for the reads still in flight, only call it once none are left
+void readEngine::lane::closeRing() {
+#ifdef __linux__
+  if (ringFd < 0) {
+    return;
+  }
+
+  munmap(sqes, sqesSize);
+  if (cqRing != sqRing) {
+    munmap(cqRing, cqRingSize);
+  }
+  munmap(sqRing, sqRingSize);
+  close(ringFd);
+  ringFd = -1;
+#endif
+}
+
+// releases the io_uring instance and its mappings
+readEngine::lane::~lane() { closeRing(); }
+
+// set up a new lane with room for 'depth' reads (returns null if the kernel does not allow another io_uring instance)
+std::unique_ptr<readEngine::lane> readEngine::openLane() {
+  std::unique_ptr<lane> l(new lane);
+  if (!setupRing(*l)) {
+    return nullptr;
+  }
+
+  return l;
+}
+
+// get the worker pool shared by the batches that run without io_uring, starting it on the first call
+threadPool &readEngine::fallbackPool() {
+  std::lock_guard<std::mutex> guard(lock);
+  if (pool == nullptr) {
+    pool.reset(new threadPool(std::min(depth, maxPoolThreads)));
+  }
+
+  return *pool;
+}
+
+// set up the io_uring instance of 'l' with room for 'depth' reads (returns false if the kernel does not allow it)
+bool readEngine::setupRing(lane &l) {
+#ifdef __linux__
+  io_uring_params params{};
+  int ring = syscall(__NR_io_uring_setup, depth, &params);
+  if (ring < 0) {
+    return false;
+  }
+
+  // sizes of the three shared memory areas (newer kernels put both rings in one mapping)
+  l.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  l.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  l.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMapping) {
+    l.sqRingSize = l.cqRingSize = std::max(l.sqRingSize, l.cqRingSize);
+  }
+
+  // map the rings and the submission queue entries
+  l.sqRing = mmap(NULL, l.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+  l.cqRing = singleMapping ? l.sqRing
+                           : mmap(NULL, l.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                                  IORING_OFF_CQ_RING);
+  l.sqes = mmap(NULL, l.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+
+  if (l.sqRing == MAP_FAILED || l.cqRing == MAP_FAILED || l.sqes == MAP_FAILED) {
+    if (l.sqes != MAP_FAILED) {
+      munmap(l.sqes, l.sqesSize);
+    }
+    if (l.cqRing != MAP_FAILED && l.cqRing != l.sqRing) {
+      munmap(l.cqRing, l.cqRingSize);
+    }
+    if (l.sqRing != MAP_FAILED) {
+      munmap(l.sqRing, l.sqRingSize);
+    }
+    close(ring);
+    return false;
+  }
+
+  // find the ring fields inside the mappings
+  char *sq = static_cast<char *>(l.sqRing), *cq = static_cast<char *>(l.cqRing);
+  l.sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  l.sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  l.sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  l.sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  l.cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  l.cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  l.cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  l.cqes = cq + params.cq_off.cqes;
+
+  l.ringFd = ring;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// run the reads through the io_uring instance of 'l', keeping up to 'depth' of them in flight
+void readEngine::readRing(lane &l, request *requests, size_t count) {
+#ifdef __linux__
+  io_uring_sqe *sqeArray = static_cast<io_uring_sqe *>(l.sqes);
+  io_uring_cqe *cqeArray = static_cast<io_uring_cqe *>(l.cqes);
+
+  // bytes of each read that have arrived so far (short reads are queued again for the rest)
+  std::vector<uint32_t> done(count, 0);
+
+  // the vectors the kernel reads into (readv works on every kernel with io_uring, plain read needs 5.6)
+  std::vector<iovec> vectors(count);
+
+  // reads waiting to be queued
+  std::deque<size_t> pending;
+  for (size_t i = 0; i < count; ++i) {
+    pending.push_back(i);
+  }
+
+  // number of reads handed to the kernel and not completed yet, number queued but not handed over yet
+  unsigned inFlight = 0, unsubmitted = 0;
+
+  // the first error (the reads already in flight are still waited for, they write into the caller's buffers)
+  std::string error;
+
+  // set once handing reads over has failed (from then on the ring is only used to wait for the reads in flight)
+  bool enterFailed = false;
+
+  // how long to sleep between polls of the completion queue once waiting through the kernel fails as well, and when
+  // the last read completed (a batch whose reads stop completing for 'maxStall' cannot be given back to the caller)
+  std::chrono::milliseconds backoff(0);
+  const std::chrono::seconds maxStall(60);
+  std::chrono::steady_clock::time_point lastCompletion = std::chrono::steady_clock::now();
+
+  while (!pending.empty() || inFlight > 0) {
+    // queue as many reads as the depth allows
+    while (!pending.empty() && inFlight < depth) {
+      size_t i = pending.front();
+      pending.pop_front();
+
+      vectors[i].iov_base = requests[i].buffer + done[i];
+      vectors[i].iov_len = requests[i].size - done[i];
+
+      unsigned tail = *l.sqTail;
+      unsigned index = tail & *l.sqMask;
+      io_uring_sqe &sqe = sqeArray[index];
+      memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_READV;
+      sqe.fd = fd;
+      sqe.off = requests[i].position + done[i];
+      sqe.addr = reinterpret_cast<uint64_t>(&vectors[i]);
+      sqe.len = 1;
+      sqe.user_data = i;
+      l.sqArray[index] = index;
+
+      // publish the entry to the kernel
+      __atomic_store_n(l.sqTail, tail + 1, __ATOMIC_RELEASE);
+      ++inFlight;
+      ++unsubmitted;
+    }
+
+    // nothing left to wait for (the reads that were never handed over were taken back after a failed submission)
+    if (inFlight == 0) {
+      break;
+    }
+
+    // hand the new reads over and wait for at least one to complete
+    int entered = syscall(__NR_io_uring_enter, l.ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (entered < 0) {
+      int cause = errno;
+      if (cause == EINTR || cause == EAGAIN || cause == EBUSY) {
+        // interrupted or out of resources for now, reap what has completed and try again
+      } else if (!enterFailed) {
+        // stop queueing and take back the entries the kernel has not consumed (they were never started), the reads
+        // it did take are still waited for below
+        enterFailed = true;
+        if (error.empty()) {
+          error = "io_uring_enter failed: " + std::string(strerror(cause));
+        }
+        pending.clear();
+        unsigned consumed = __atomic_load_n(l.sqHead, __ATOMIC_ACQUIRE);
+        unsigned notStarted = *l.sqTail - consumed;
+        __atomic_store_n(l.sqTail, consumed, __ATOMIC_RELEASE);
+        inFlight -= notStarted;
+        unsubmitted = 0;
+      } else {
+        // the kernel cannot be waited on either, but the reads it took still post their completions to the shared
+        // ring, so poll it with a growing pause until they are all in (they write into the caller's buffers and
+        // 'vectors', nothing may be handed back before that)
+        l.broken = true;
+        if (std::chrono::steady_clock::now() - lastCompletion > maxStall) {
+          // the buffers can neither be handed back nor kept safe, stopping the process is the only safe way out
+          std::terminate();
+        }
+        backoff = std::min(std::max(backoff * 2, std::chrono::milliseconds(1)), std::chrono::milliseconds(100));
+        std::this_thread::sleep_for(backoff);
+      }
+    } else {
+      unsubmitted -= entered;
+    }
+
+    // collect the completed reads
+    unsigned head = *l.cqHead;
+    while (head != __atomic_load_n(l.cqTail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe &cqe = cqeArray[head & *l.cqMask];
+      size_t i = cqe.user_data;
+      int result = cqe.res;
+      ++head;
+      --inFlight;
+      lastCompletion = std::chrono::steady_clock::now();
+
+      if (result == -EAGAIN || result == -EINTR) {
+        // interrupted, try again (unless queueing has stopped)
+        if (error.empty()) {
+          pending.push_back(i);
+        }
+      } else if (result <= 0) {
+        // failed or hit the end of the file, stop queueing and remember why
+        if (error.empty()) {
+          error = result == 0 ? "the requested range is outside of the VDI file" : strerror(-result);
+        }
+        pending.clear();
+      } else {
+        // arrived (maybe only partially)
+        done[i] += result;
+        if (done[i] < requests[i].size && error.empty()) {
+          pending.push_back(i);
+        }
+      }
+    }
+    __atomic_store_n(l.cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  // every read has finished, a ring that could not be waited on is released and its lane never used again
+  if (l.broken) {
+    l.closeRing();
+  }
+
+  if (!error.empty()) {
+    throw std::runtime_error("cannot read, " + error);
+  }
+#else
+  (void)requests;
+  (void)count;
+#endif
+}
+
+// run the reads on the shared worker pool, as many of them at a time as it has free workers
+void readEngine::readPool(request *requests, size_t count) {
+#ifndef _WIN32
+  threadPool &workers = fallbackPool();
+
+  // the pool is shared with the batches of other threads, so this batch counts its own reads instead of using 'wait'
+  size_t unfinished = count;
+  bool failed = false;
+  std::mutex batchLock;
+  std::condition_variable allDone;
+
+  for (size_t i = 0; i < count; ++i) {
+    request r = requests[i];
+    workers.submit([this, r, &unfinished, &failed, &batchLock, &allDone]() mutable {
+      // 'pread' may return less than requested, keep reading until everything has arrived
+      bool ok = true;
+      while (r.size > 0) {
+        ssize_t read = pread(fd, r.buffer, r.size, r.position);
+        if (read <= 0) {
+          ok = false;
+          break;
+        }
+        r.buffer += read;
+        r.position += read;
+        r.size -= read;
+      }
+
+      std::lock_guard<std::mutex> guard(batchLock);
+      failed = failed || !ok;
+      if (--unfinished == 0) {
+        allDone.notify_one();
+      }
+    });
+  }
+
+  std::unique_lock<std::mutex> guard(batchLock);
+  allDone.wait(guard, [&unfinished] { return unfinished == 0; });
+  if (failed) {
+    throw std::runtime_error("cannot read, the requested range is outside of the VDI file");
+  }
+#else
+  (void)requests;
+  (void)count;
+#endif
+}
+
+// run all 'count' reads starting at 'requests' and block until every one of them has finished
+// note: safe to call from multiple threads at once (every batch runs on a lane of its own, up to 'depth' reads each)
+void readEngine::read(request *requests, size_t count) {
+  // borrow an idle lane, or set up another one when every lane is busy with a batch of another thread
+  std::unique_ptr<lane> l;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!idleLanes.empty()) {
+      l = std::move(idleLanes.back());
+      idleLanes.pop_back();
+    }
+  }
+  if (l == nullptr && ringAvailable) {
+    l = openLane();
+  }
+
+  // without io_uring (or when the kernel allows no more instances) the batch runs on the shared pool
+  if (l == nullptr) {
+    readPool(requests, count);
+    return;
+  }
+
+  // give the lane back whether or not the batch failed (every read of it has finished either way), unless its ring
+  // had to be torn down
+  try {
+    readRing(*l, requests, count);
+  } catch (...) {
+    if (!l->broken) {
+      std::lock_guard<std::mutex> guard(lock);
+      idleLanes.push_back(std::move(l));
+    }
+    throw;
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  idleLanes.push_back(std::move(l));
+}
+
+// checks if the reads go through io_uring (true) or the worker pool fallback (false)
+bool readEngine::usingRing() const { return ringAvailable; }
+
+// get the largest number of reads in flight at once
+unsigned readEngine::queueDepth() const { return depth; }
@@ -0,0 +1,127 @@
+//
+// Header for the asynchronous read engine class (io_uring, with a thread pool fallback)
+//
+
+#ifndef OS_TERM_PROJECT_READENGINE_H
+#define OS_TERM_PROJECT_READENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "threadPool.h"
+
+class readEngine {
+ public:
+  /* VARIABLES */
+
+  // largest number of reads of one batch in flight at once (the kernel refuses larger io_uring instances)
+  static const unsigned maxQueueDepth = 32768;
+
+  // structure of a single read: 'size' bytes at byte 'position' of the file into 'buffer'
+  struct request {
+    char *buffer;
+    uint64_t position;
+    uint32_t size;
+  };
+
+ private:
+  /* VARIABLES */
+
+  // structure of one submitter's set of reads in flight: an io_uring instance (each batch borrows a lane of its own, so
+  // batches from different threads are in flight at the same time)
+  struct lane {
+    // descriptor of the io_uring instance (-1 = not set up or already released)
+    int ringFd = -1;
+
+    // memory mappings of the submission queue ring, completion queue ring and submission queue entries
+    void *sqRing = NULL, *cqRing = NULL, *sqes = NULL;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+
+    // the fields of the shared rings (pointers into the mappings above)
+    unsigned *sqHead = NULL, *sqTail = NULL, *sqMask = NULL, *sqArray = NULL;
+    unsigned *cqHead = NULL, *cqTail = NULL, *cqMask = NULL;
+    void *cqes = NULL;
+
+    // set when the kernel could not be waited on (the ring is released once its reads are in and the lane is never
+    // handed to another batch)
+    bool broken = false;
+
+    // releases the io_uring instance and its mappings
+    // note: closing the ring neither cancels nor waits for the reads still in flight, only call it once none are left
+    void closeRing();
+
+    // releases the io_uring instance and its mappings
+    ~lane();
+  };
+
+  // largest number of worker threads in the fallback pool (a deeper queue only waits longer for a free worker)
+  static const unsigned maxPoolThreads = 64;
+
+  // descriptor of the file that is read from
+  int fd;
+
+  // largest number of reads in flight at once per batch
+  unsigned depth;
+
+  // whether the lanes use io_uring (decided by the first lane, every later one is set up the same way)
+  bool ringAvailable = false;
+
+  // lanes that no batch is using right now (a batch that finds none sets up a new one)
+  std::vector<std::unique_ptr<lane>> idleLanes;
+
+  // workers doing one blocking read each where io_uring is not available, shared by every batch (started on first use)
+  std::unique_ptr<threadPool> pool;
+
+  // guards 'idleLanes' and 'pool'
+  std::mutex lock;
+
+  /* METHODS */
+
+  // set up a new lane with room for 'depth' reads (returns null if the kernel does not allow another io_uring instance)
+  std::unique_ptr<lane> openLane();
+
+  // get the worker pool shared by the batches that run without io_uring, starting it on the first call
+  threadPool &fallbackPool();
+
+  // set up the io_uring instance of 'l' with room for 'depth' reads (returns false if the kernel does not allow it)
+  bool setupRing(lane &l);
+
+  // run the reads through the io_uring instance of 'l', keeping up to 'depth' of them in flight
+  void readRing(lane &l, request *requests, size_t count);
+
+  // run the reads on the shared worker pool, as many of them at a time as it has free workers
+  void readPool(request *requests, size_t count);
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that reads from the descriptor 'fd' with up to 'queueDepth' reads of each batch in flight at once
+  // (uses io_uring where the kernel allows it, otherwise one pool of up to 'maxPoolThreads' worker threads)
+  readEngine(int fd, unsigned queueDepth);
+
+  // the lanes are owned by exactly one engine
+  readEngine(const readEngine &) = delete;
+  readEngine &operator=(const readEngine &) = delete;
+
+  /* DESTRUCTOR */
+
+  // releases the lanes
+  ~readEngine() = default;
+
+  /* METHODS */
+
+  // run all 'count' reads starting at 'requests' and block until every one of them has finished
+  // note: safe to call from multiple threads at once (every batch runs on a lane of its own, up to 'depth' reads each)
+  void read(request *requests, size_t count);
+
+  // checks if the reads go through io_uring (true) or the worker pool fallback (false)
+  bool usingRing() const;
+
+  // get the largest number of reads of one batch in flight at once
+  unsigned queueDepth() const;
+};
+
+#endif  // OS_TERM_PROJECT_READENGINE_H
@@ -0,0 +1,179 @@
+//
+// Implementation of the thread pool class (work-stealing)
+//
+
+#include "threadPool.h"
+
+#include <algorithm>
+
+// the pool and queue of the worker thread running the current code (NULL outside of any worker thread)
+static thread_local threadPool *currentPool = NULL;
+static thread_local size_t currentQueue = 0;
+
+// constructor that starts 'threadCount' worker threads (0 = one per hardware thread)
+threadPool::threadPool(unsigned threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // every queue has to exist before any worker starts stealing
+  for (unsigned i = 0; i < threadCount; ++i) {
+    queues.emplace_back(new workerQueue);
+  }
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    workers.emplace_back(&threadPool::workerLoop, this, i);
+  }
+}
+
+// finishes every queued task and joins the worker threads
+threadPool::~threadPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  taskReady.notify_all();
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// take the next task for worker 'self' out of its own queue or, if that is empty, steal one from another worker
+// returns true on success, false if every queue is empty
+bool threadPool::takeTask(size_t self, std::function<void()> &task) {
+  // own queue first, front to back
+  {
+    workerQueue &own = *queues[self];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      --queued;
+      return true;
+    }
+  }
+
+  // steal from the back of the other queues, starting with the next worker
+  for (size_t i = 1; i < queues.size(); ++i) {
+    workerQueue &victim = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      --queued;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// loop run by every worker thread: take a task (own queue first, then steal), run it, repeat until stopping
+void threadPool::workerLoop(size_t self) {
+  currentPool = this;
+  currentQueue = self;
+
+  while (true) {
+    std::function<void()> task;
+
+    if (!takeTask(self, task)) {
+      // nothing to take, sleep until a task is queued (queued tasks are still finished when stopping)
+      std::unique_lock<std::mutex> guard(lock);
+      taskReady.wait(guard, [this] { return stopping || queued > 0; });
+      if (stopping && queued == 0) {
+        return;
+      }
+      continue;
+    }
+
+    // run the task, remembering the first failure
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    // mark the task as finished
+    std::lock_guard<std::mutex> guard(lock);
+    if (error && !failure) {
+      failure = error;
+    }
+    if (--unfinished == 0) {
+      allDone.notify_all();
+    }
+  }
+}
+
+// add 'count' tasks to the number of unfinished tasks
+// (done before the tasks are queued, so a worker can never finish a task that is not counted yet)
+void threadPool::announce(size_t count) {
+  std::lock_guard<std::mutex> guard(lock);
+  unfinished += count;
+}
+
+// wake 'all' or one of the sleeping workers after tasks were queued
+// (taking 'lock' first means a worker is either already asleep or has not checked 'queued' yet, so none can miss it)
+void threadPool::wake(bool all) {
+  { std::lock_guard<std::mutex> guard(lock); }
+
+  if (all) {
+    taskReady.notify_all();
+  } else {
+    taskReady.notify_one();
+  }
+}
+
+// queue a task to be run by one of the workers
+// (a task submitted from inside another task goes to that worker's own queue, others are spread round-robin)
+void threadPool::submit(std::function<void()> task) {
+  size_t target = currentPool == this ? currentQueue : nextQueue++ % queues.size();
+  announce(1);
+
+  {
+    workerQueue &queue = *queues[target];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+    ++queued;
+  }
+
+  wake(false);
+}
+
+// queue a list of tasks split into one contiguous chunk per worker, keeping their order inside each chunk
+// (each worker runs its chunk front to back, idle workers steal from the far end of the other chunks)
+void threadPool::submitOrdered(std::vector<std::function<void()>> tasks) {
+  size_t chunk = (tasks.size() + queues.size() - 1) / queues.size();
+  announce(tasks.size());
+
+  for (size_t i = 0; i < queues.size(); ++i) {
+    size_t begin = std::min(i * chunk, tasks.size()), end = std::min(begin + chunk, tasks.size());
+
+    workerQueue &queue = *queues[i];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    for (size_t j = begin; j < end; ++j) {
+      queue.tasks.push_back(std::move(tasks[j]));
+    }
+    queued += end - begin;
+  }
+
+  wake(true);
+}
+
+// block until every submitted task has finished
+// note: rethrows the first exception thrown by a task (tasks that should not stop the batch must catch their own)
+void threadPool::wait() {
+  std::unique_lock<std::mutex> guard(lock);
+  allDone.wait(guard, [this] { return unfinished == 0; });
+
+  // hand the first failure to the caller (only once)
+  if (failure) {
+    std::exception_ptr error = failure;
+    failure = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+// get the number of worker threads
+size_t threadPool::size() const { return workers.size(); }
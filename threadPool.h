@@ -0,0 +1,108 @@
+//
+// Header for the thread pool class (work-stealing)
+//
+
+#ifndef OS_TERM_PROJECT_THREADPOOL_H
+#define OS_TERM_PROJECT_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class threadPool {
+ private:
+  /* VARIABLES */
+
+  // structure of a worker's own task queue
+  // (the owner takes tasks from the front, idle workers steal from the back)
+  struct workerQueue {
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+  };
+
+  // the worker threads
+  std::vector<std::thread> workers;
+
+  // one task queue per worker thread
+  std::vector<std::unique_ptr<workerQueue>> queues;
+
+  // number of tasks sitting in the queues (only changed while holding the lock of the queue the task is in)
+  std::atomic<size_t> queued{0};
+
+  // queue that the next task submitted from outside the pool goes to
+  std::atomic<size_t> nextQueue{0};
+
+  // number of tasks submitted but not finished yet (queued or running)
+  size_t unfinished = 0;
+
+  // set when the pool is being destroyed so the workers exit
+  bool stopping = false;
+
+  // the first exception thrown by a task (rethrown by 'wait')
+  std::exception_ptr failure;
+
+  // guards 'unfinished', 'stopping' and 'failure'
+  std::mutex lock;
+
+  // signalled when a task is queued or the pool is stopping
+  std::condition_variable taskReady;
+
+  // signalled when the last unfinished task finishes
+  std::condition_variable allDone;
+
+  /* METHODS */
+
+  // loop run by every worker thread: take a task (own queue first, then steal), run it, repeat until stopping
+  void workerLoop(size_t self);
+
+  // take the next task for worker 'self' out of its own queue or, if that is empty, steal one from another worker
+  // returns true on success, false if every queue is empty
+  bool takeTask(size_t self, std::function<void()> &task);
+
+  // add 'count' tasks to the number of unfinished tasks (before they are queued)
+  void announce(size_t count);
+
+  // wake 'all' or one of the sleeping workers after tasks were queued
+  void wake(bool all);
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that starts 'threadCount' worker threads (0 = one per hardware thread)
+  explicit threadPool(unsigned threadCount);
+
+  // the workers hold a pointer to the pool
+  threadPool(const threadPool &) = delete;
+  threadPool &operator=(const threadPool &) = delete;
+
+  /* DESTRUCTOR */
+
+  // finishes every queued task and joins the worker threads
+  ~threadPool();
+
+  /* METHODS */
+
+  // queue a task to be run by one of the workers
+  // (a task submitted from inside another task goes to that worker's own queue, others are spread round-robin)
+  void submit(std::function<void()> task);
+
+  // queue a list of tasks split into one contiguous chunk per worker, keeping their order inside each chunk
+  // (each worker runs its chunk front to back, idle workers steal from the far end of the other chunks)
+  void submitOrdered(std::vector<std::function<void()>> tasks);
+
+  // block until every submitted task has finished
+  // note: rethrows the first exception thrown by a task (tasks that should not stop the batch must catch their own)
+  void wait();
+
+  // get the number of worker threads
+  size_t size() const;
+};
+
+#endif  // OS_TERM_PROJECT_THREADPOOL_H
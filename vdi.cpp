@@ -4,47 +4,97 @@
 
 #include "vdi.h"
 
+#include <algorithm>
 #include <bitset>
 #include <cmath>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-
-// only constructor, takes path to VDI file
-vdi::vdi(const char *filePath) : filePath(filePath) {
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "byteOrder.h"
+#include "dirHash.h"
+#include "imageFile.h"
+#include "threadPool.h"
+
+// constructor that takes path to VDI file, the storage backend to read it through and the number of the partition whose
+// filesystem is read (1 based, in the order of the MBR or GPT)
+vdi::vdi(const char *filePath, ioBackend backend, int partition) : filesystemPartition(partition), filePath(filePath) {
   // open the VDI file with the path given
   VDI_file.open(filePath, std::ios::in | std::ios::out | std::ios::binary);
 
-  // fill out the header struct with the opened file
-  setHeader();
+  // open the image file for the positional reads (and map all of it into memory when the mmap backend is requested)
+  source = std::make_shared<imageFile>(filePath, backend == ioBackend::mmap);
+  mappedFile = source->mapping();
+
+  // pick the container format by the image's magic number (it reads its own header and lookup tables, and keeps the
+  // image file open for as long as any handle uses it)
+  std::shared_ptr<imageFile> file = source;
+  image = container::open([file](char *buffer, uint64_t position, uint32_t size) { file->read(buffer, position, size); },
+                          source->size());
 
   // fill out the partition table struct with the opened file
   setPartitionTable();
 
-  // fill out the superblock struct with the opened file
-  setSuperblock();
+  // read the superblock and block group descriptors of the chosen partition
+  openFilesystem();
+}
+
+// constructor for a handle on the filesystem of partition 'partition' of the image opened by 'disk'
+// (shares the opened file, memory mapping and container with it but has its own caches and read engine)
+vdi::vdi(const vdi &disk, int partition)
+    : source(disk.source),
+      filesystemPartition(partition),
+      image(disk.image),
+      mappedFile(disk.mappedFile),
+      partitionTable(disk.partitionTable),
+      filePath(disk.filePath) {
+  // the cursor API gets its own cursor
+  VDI_file.open(filePath, std::ios::in | std::ios::out | std::ios::binary);
+
+  // read the superblock and block group descriptors of the chosen partition
+  openFilesystem();
+}
+
+// releases the block group descriptors and the read engine (the image file is closed by the last handle on it)
+vdi::~vdi() {
+  // the engine reads through the image file's descriptor, so it goes first
+  engine.reset();
 
-  // get file size
-  VDI_file.seekg(0, std::ios::end);
-  fileSize = VDI_file.tellg();
+  delete[] bgdt;
+}
 
-  // get the start location of the virtual disk
-  partitionOpen(1);
+// opens the filesystem of partition 'filesystemPartition' (reads the superblock and block group descriptors)
+void vdi::openFilesystem() {
+  // get the start location of the partition (checks that it exists)
+  partitionOpen(filesystemPartition);
   diskStart = openedPartitionStart;
+  partitionStart = partitionTable[filesystemPartition - 1].first_LBA_sector * image->sectorSize();
   partitionClose();
 
+  // fill out the superblock struct with the opened file
+  setSuperblock();
+
   // fill out the array of "block group descriptor table" structs with the opened file
   bgdt = new blockGroupDescriptorTable[superblock.blockGroupCount];
   fetchBGDT(bgdt, 1);
 
-  /* TODO:
-   * The pointer "bgdt" will cause a memory leak. This is intentional because this program is meant to do one task very
-   * quickly and then close. If this vdi class is ever extended to be used in another program that has a longer runtime
-   * then "bgdt" needs to be properly deleted when it is no longer needed. Until then, leaving the memory leak in allows
-   * the program to run a bit quicker with no negative side effects. Small popular programs such as GNU's "ls" use this
-   * technique https://lists.gnu.org/archive/html/bug-coreutils/2011-05/msg00065.html
-   */
-
   // reset file cursor
   VDI_file.seekg(0);
 
@@ -52,6 +102,98 @@ vdi::vdi(const char *filePath) : filePath(filePath) {
   VDI_file.clear();
 }
 
+// read 'size' amount bytes starting at byte 'position' inside the virtual disk into buffer
+// note: does not use or move the file cursor, so it is safe to call from multiple threads at once
+void vdi::readAt(char *buffer, uint64_t position, uint32_t size) {
+  // smallest piece a large read is split into for the read engine
+  const uint32_t minPiece = 128 << 10;
+
+  // large reads go through the engine in pieces that are all in flight together
+  if (engine != nullptr && size >= 2 * minPiece) {
+    uint32_t piece = std::max(minPiece, (size / engine->queueDepth() + 4095) / 4096 * 4096);
+
+    std::vector<readEngine::request> pieces;
+    for (uint32_t done = 0; done < size; done += piece) {
+      pieces.push_back({buffer + done, position + done, std::min(piece, size - done)});
+    }
+
+    readBatch(pieces.data(), pieces.size());
+    return;
+  }
+
+  // offset position to start at the beginning of the partition
+  readDisk(buffer, partitionStart + position, size);
+}
+
+// read 'size' bytes starting at byte 'diskPosition' of the virtual disk (not the partition) into buffer
+// (split into the pieces the container stores contiguously, unallocated pieces read back as zeros without any I/O)
+void vdi::readDisk(char *buffer, uint64_t diskPosition, uint32_t size) {
+  while (size > 0) {
+    uint32_t piece = size;
+    uint64_t filePosition;
+
+    if (image->locate(diskPosition, piece, filePosition)) {
+      source->read(buffer, filePosition, piece);
+    } else {
+      memset(buffer, 0, piece);
+    }
+
+    buffer += piece;
+    diskPosition += piece;
+    size -= piece;
+  }
+}
+
+// run the 'count' reads starting at 'requests' at once through the read engine (see 'setQueueDepth') and block until
+// every one of them has finished (the positions are bytes inside the virtual disk, like 'readAt')
+void vdi::readBatch(const readEngine::request *requests, size_t count) {
+  // without an engine the reads are simply done one after the other
+  if (engine == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      readAt(requests[i].buffer, requests[i].position, requests[i].size);
+    }
+    return;
+  }
+
+  // translate the reads into image file positions (split into the pieces the container stores contiguously)
+  std::vector<readEngine::request> filePositions;
+  for (size_t i = 0; i < count; ++i) {
+    readEngine::request r = requests[i];
+    r.position += partitionStart;
+
+    while (r.size > 0) {
+      uint32_t piece = r.size;
+      uint64_t filePosition;
+
+      if (image->locate(r.position, piece, filePosition)) {
+        filePositions.push_back({r.buffer, filePosition, piece});
+      } else {
+        memset(r.buffer, 0, piece);
+      }
+
+      r.buffer += piece;
+      r.position += piece;
+      r.size -= piece;
+    }
+  }
+
+  engine->read(filePositions.data(), filePositions.size());
+}
+
+// keep up to 'depth' reads in flight at once (io_uring where the kernel allows it, otherwise worker threads)
+// note: large reads are split into 'depth' pieces and indirect blocks are prefetched in batches (0 or 1 = one
+// synchronous read at a time, which is the default, no effect with the mmap backend or on Windows)
+void vdi::setQueueDepth(unsigned depth) {
+  engine.reset();
+
+#ifndef _WIN32
+  // the mapping is already faster than any read
+  if (depth > 1 && mappedFile == NULL) {
+    engine.reset(new readEngine(source->descriptor(), depth));
+  }
+#endif
+}
+
 // read 'size' amount bytes from VDI into buffer (starting at cursor)
 void vdi::read(char *buffer, std::streamsize size) {
   // forward parameters to the builtin 'fstream' method
@@ -163,21 +305,6 @@ void vdi::seek(std::ios::off_type offset, std::ios_base::seekdir direction) {
 //   std::cout.flags(oldFlags);
 // }
 
-// converts the given character buffer from little endian to a single uint64_t ('size' = length of buffer)
-// note: 'size' should never be greater than 8
-uint64_t vdi::littleEndianToInt(const char *buffer, uint8_t size) {
-  // input error checking
-  if (size > 8) {
-    throw std::invalid_argument("'size' should never be greater than 8");
-  }
-
-  // copy the buffer memory into a 64-bit int
-  uint64_t result;
-  memcpy(&result, buffer, size);
-
-  return result;
-}
-
 // converts an int to a hex in little endian format and places the result into a character buffer
 // (buffer size of 4 will hold the full int, less than 4 will truncate)
 // TODO: unused function, commented out for now
@@ -206,98 +333,206 @@ uint64_t vdi::littleEndianToInt(const char *buffer, uint8_t size) {
 //   }
 // }
 
-// sets the values in the header struct
-void vdi::setHeader() {
-  // temporary buffer for reading in header values
-  char buffer[8];
+// sets the values of the partition table (the 4 MBR entries, or every entry of the GPT on GPT disks)
+void vdi::setPartitionTable() {
+  // the whole raw partition table (the MBR is the first sector of the virtual disk, so it is translated like any other
+  // read on a dynamic image)
+  char buffer[64];
+  readDisk(buffer, 0x1be, sizeof(buffer));
+
+  // loop through all 4 partition entries in the partition table
+  partitionTable.assign(4, partitionEntry{});
+  const char *raw = buffer;
+  for (auto &entry : partitionTable) {
+    // get status (active/inactive)
+    entry.status = littleEndianToInt(raw, 1);
+
+    // get first sector CHS
+    entry.firstSectorCHS[1] = littleEndianToInt(raw + 1, 1);
+    entry.firstSectorCHS[2] = littleEndianToInt(raw + 2, 1);
+    entry.firstSectorCHS[0] = littleEndianToInt(raw + 3, 1);
 
-  // get image type (1 = dynamic, 2 = static)
-  VDI_file.seekg(0x4c);
-  VDI_file.read(buffer, 4);
-  header.imageType = littleEndianToInt(buffer, 4);
+    // get partition type
+    entry.type = littleEndianToInt(raw + 4, 1);
 
-  // get offset blocks
-  VDI_file.seekg(0x154);
-  VDI_file.read(buffer, 4);
-  header.offsetBlocks = littleEndianToInt(buffer, 4);
+    // get last sector CHS
+    entry.lastSectorCHS[1] = littleEndianToInt(raw + 5, 1);
+    entry.lastSectorCHS[2] = littleEndianToInt(raw + 6, 1);
+    entry.lastSectorCHS[0] = littleEndianToInt(raw + 7, 1);
 
-  // get offset data
-  VDI_file.read(buffer, 4);
-  header.offsetData = littleEndianToInt(buffer, 4);
+    // get first LBA sector
+    entry.first_LBA_sector = littleEndianToInt(raw + 8, 4);
 
-  // get sector size
-  VDI_file.seekg(0x168);
-  VDI_file.read(buffer, 4);
-  header.sectorSize = littleEndianToInt(buffer, 4);
+    // get LBA sector count
+    entry.LBA_sector_count = littleEndianToInt(raw + 12, 4);
 
-  // get disk size
-  VDI_file.seekg(0x170);
-  VDI_file.read(buffer, 8);
-  header.diskSize = littleEndianToInt(buffer, 8);
+    raw += 16;
+  }
 
-  // get block size
-  VDI_file.read(buffer, 4);
-  header.blockSize = littleEndianToInt(buffer, 4);
+  char signature[2], magic[2];
+  readDisk(signature, 0x1fe, sizeof(signature));
+
+  // a protective MBR entry means the real partition table is the GPT (the primary header is in the second sector, the
+  // backup one in the last sector of the disk)
+  if (littleEndianToInt(signature, 2) == 0xaa55) {
+    for (const auto &entry : partitionTable) {
+      if (entry.type == gptProtectiveType) {
+        uint64_t lastLBA = image->diskSize() / image->sectorSize() - 1;
+        if (!readGPT(1) && !readGPT(lastLBA)) {
+          throw std::runtime_error("the disk has a protective MBR but no valid GPT");
+        }
+        return;
+      }
+    }
+  }
 
-  // get blocks in HDD
-  VDI_file.seekg(0x180);
-  VDI_file.read(buffer, 4);
-  header.blocksInHDD = littleEndianToInt(buffer, 4);
+  // no MBR boot signature but an ext2 superblock right at the start: a bare filesystem without a partition table
+  // (e.g. a raw image of a single partition), treat the whole disk as partition 1
+  readDisk(magic, 1024 + 56, sizeof(magic));
+  if (littleEndianToInt(signature, 2) != 0xaa55 && littleEndianToInt(magic, 2) == 0xef53) {
+    partitionTable.assign(1, partitionEntry{});
+    partitionTable[0].type = 0x83;
+    partitionTable[0].LBA_sector_count = image->diskSize() / image->sectorSize();
+  }
+}
 
-  // get blocks allocated
-  VDI_file.read(buffer, 4);
-  header.blocksAllocated = littleEndianToInt(buffer, 4);
+// get the CRC-32 (the one of zlib and the GPT) of the 'size' bytes starting at 'data'
+static uint32_t crc32(const char *data, size_t size) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= (uint8_t)data[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
 }
 
-// sets the values of the partition table
-void vdi::setPartitionTable() {
-  // temporary buffer for reading in partition entry values
-  char buffer[4];
+// read the GPT whose header is at sector 'headerLBA' into the partition table (returns false if there is no valid GPT
+// header there)
+bool vdi::readGPT(uint64_t headerLBA) {
+  uint32_t sectorSize = image->sectorSize();
+  uint64_t diskSectors = image->diskSize() / sectorSize;
 
-  // move cursor to start of partition table
-  VDI_file.seekg(header.offsetData + 0x1be);
+  // a header outside of the disk (a disk too small to hold one) is no header
+  if (headerLBA >= diskSectors) {
+    return false;
+  }
 
-  // loop through all 4 partition entries in the partition table
-  for (auto &entry : partitionTable) {
-    // get status (active/inactive)
-    VDI_file.read(buffer, 1);
-    entry.status = littleEndianToInt(buffer, 1);
+  // the raw header (its size is given inside it, the rest of the sector is reserved)
+  std::vector<char> header(sectorSize);
+  readDisk(header.data(), headerLBA * sectorSize, sectorSize);
 
-    // get first sector CHS
-    VDI_file.read(buffer, 1);
-    entry.firstSectorCHS[1] = littleEndianToInt(buffer, 1);
-    VDI_file.read(buffer, 1);
-    entry.firstSectorCHS[2] = littleEndianToInt(buffer, 1);
-    VDI_file.read(buffer, 1);
-    entry.firstSectorCHS[0] = littleEndianToInt(buffer, 1);
+  // check the signature and the checksum of the header (computed with the checksum field itself zeroed)
+  uint32_t headerSize = littleEndianToInt(header.data() + 12, 4);
+  if (memcmp(header.data(), "EFI PART", 8) != 0 || headerSize < 92 || headerSize > sectorSize) {
+    return false;
+  }
+  uint32_t headerCRC = littleEndianToInt(header.data() + 16, 4);
+  memset(header.data() + 16, 0, 4);
+  if (crc32(header.data(), headerSize) != headerCRC || littleEndianToInt(header.data() + 24, 8) != headerLBA) {
+    return false;
+  }
 
-    // get partition type
-    VDI_file.read(buffer, 1);
-    entry.type = littleEndianToInt(buffer, 1);
+  // get the location, number and size of the partition entries
+  uint64_t entriesLBA = littleEndianToInt(header.data() + 72, 8);
+  uint32_t entryCount = littleEndianToInt(header.data() + 80, 4);
+  uint32_t entrySize = littleEndianToInt(header.data() + 84, 4);
+  if (entrySize < 128 || entrySize % 8 != 0 || entryCount == 0 || (uint64_t)entryCount * entrySize > (64 << 20)) {
+    return false;
+  }
 
-    // get last sector CHS
-    VDI_file.read(buffer, 1);
-    entry.lastSectorCHS[1] = littleEndianToInt(buffer, 1);
-    VDI_file.read(buffer, 1);
-    entry.lastSectorCHS[2] = littleEndianToInt(buffer, 1);
-    VDI_file.read(buffer, 1);
-    entry.lastSectorCHS[0] = littleEndianToInt(buffer, 1);
+  // the entry array has to be inside the disk (a damaged header is rejected here so the backup one gets its turn)
+  uint64_t entriesSectors = ((uint64_t)entryCount * entrySize + sectorSize - 1) / sectorSize;
+  if (entriesLBA >= diskSectors || entriesSectors > diskSectors - entriesLBA) {
+    return false;
+  }
 
-    // get first LBA sector
-    VDI_file.read(buffer, 4);
-    entry.first_LBA_sector = littleEndianToInt(buffer, 4);
+  // read the whole entry array at once and check its checksum
+  std::vector<char> entries((size_t)entryCount * entrySize);
+  readDisk(entries.data(), entriesLBA * sectorSize, entries.size());
+  if (crc32(entries.data(), entries.size()) != littleEndianToInt(header.data() + 88, 4)) {
+    return false;
+  }
 
-    // get LBA sector count
-    VDI_file.read(buffer, 4);
-    entry.LBA_sector_count = littleEndianToInt(buffer, 4);
+  // partition numbers are the positions in the array, so unused entries in between are kept (with no sectors)
+  partitionTable.assign(entryCount, partitionEntry{});
+  size_t used = 0;
+  for (uint32_t i = 0; i < entryCount; ++i) {
+    const char *raw = entries.data() + (size_t)i * entrySize;
+    partitionEntry &entry = partitionTable[i];
+
+    // get type GUID (all zeros = unused entry)
+    memcpy(entry.typeGUID, raw, sizeof(entry.typeGUID));
+    if (std::all_of(raw, raw + 16, [](char c) { return c == 0; })) {
+      continue;
+    }
+
+    // get first LBA sector and LBA sector count (the last LBA sector is inclusive)
+    uint64_t first = littleEndianToInt(raw + 32, 8), last = littleEndianToInt(raw + 40, 8);
+    if (last < first || last >= diskSectors) {
+      continue;
+    }
+    entry.first_LBA_sector = first;
+    entry.LBA_sector_count = last - first + 1;
+
+    // get name (UTF-16, characters outside of ASCII are replaced)
+    for (uint32_t c = 0; c < 36; ++c) {
+      uint16_t unit = littleEndianToInt(raw + 56 + c * 2, 2);
+      if (unit == 0) {
+        break;
+      }
+      entry.name += unit < 0x80 ? (char)unit : '?';
+    }
+
+    used = i + 1;
+  }
+
+  // drop the unused entries at the end of the array
+  partitionTable.resize(used);
+
+  return true;
+}
+
+// get the number of the partition whose filesystem this handle reads (1 based)
+int vdi::partitionNumber() const { return filesystemPartition; }
+
+// checks if the filesystem was not cleanly unmounted and its journal still has to be replayed (the journal is not
+// read, so recently changed files may be read from stale metadata)
+bool vdi::needsRecovery() const { return superblock.featureIncompat & incompatRecover; }
+
+// describe partition 'number' for error messages (its number with its GPT name and type GUID, or its MBR type)
+std::string vdi::describePartition(int number) const {
+  const partitionEntry &entry = partitionTable[number - 1];
+  std::ostringstream description;
+  description << "partition " << number;
+
+  // MBR entries (and a bare filesystem) have no type GUID
+  if (std::all_of(entry.typeGUID, entry.typeGUID + 16, [](uint8_t b) { return b == 0; })) {
+    description << " (type 0x" << std::hex << std::setw(2) << std::setfill('0') << (int)entry.type << ")";
+    return description.str();
+  }
+
+  // the first three fields of a GUID are little endian, the last two are kept in order
+  static const int order[16] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+  if (!entry.name.empty()) {
+    description << " '" << entry.name << "'";
   }
+  description << " (type " << std::hex << std::uppercase << std::setfill('0');
+  for (int i = 0; i < 16; ++i) {
+    description << (i == 4 || i == 6 || i == 8 || i == 10 ? "-" : "") << std::setw(2) << (int)entry.typeGUID[order[i]];
+  }
+  description << ")";
+
+  return description.str();
 }
 
-// open a partition by its number (1-4)
+// open a partition by its number (1 based, 1-4 on MBR disks)
 void vdi::partitionOpen(int number) {
   // check for valid partition number
-  if (number < 1 || number > 4) {
-    throw std::invalid_argument("partition number must be 1-4, received: " + std::to_string(number));
+  if (number < 1 || (size_t)number > partitionTable.size()) {
+    throw std::invalid_argument("partition number must be 1-" + std::to_string(partitionTable.size()) +
+                                ", received: " + std::to_string(number));
   }
 
   // check that the selected partition is formatted
@@ -308,9 +543,24 @@ void vdi::partitionOpen(int number) {
   // set opened partition
   openedPartition = number;
 
-  // set opened partition start and end locations
-  openedPartitionStart = (partitionTable[number - 1].first_LBA_sector * header.sectorSize) + header.offsetData;
-  openedPartitionEnd = (openedPartitionStart + partitionTable[number - 1].LBA_sector_count) + header.offsetData;
+  // the cursor reads the image file directly, which only works if the partition is stored in one piece and in order
+  // (raw and fixed VDI images, sparse images keep their data in whatever order it was written)
+  uint64_t diskPosition = partitionTable[number - 1].first_LBA_sector * image->sectorSize();
+  uint64_t partitionBytes = partitionTable[number - 1].LBA_sector_count * image->sectorSize();
+  uint64_t filePosition = 0;
+  uint32_t length = std::min<uint64_t>(partitionBytes, UINT32_MAX);
+  openedPartitionInOrder = image->locate(diskPosition, length, filePosition);
+  uint64_t expected = filePosition + length;
+  for (uint64_t done = length; openedPartitionInOrder && done < partitionBytes; done += length) {
+    uint64_t piecePosition = 0;
+    length = std::min<uint64_t>(partitionBytes - done, UINT32_MAX);
+    openedPartitionInOrder = image->locate(diskPosition + done, length, piecePosition) && piecePosition == expected;
+    expected += length;
+  }
+
+  // set opened partition start and end locations (positions in the image file)
+  openedPartitionStart = filePosition;
+  openedPartitionEnd = openedPartitionStart + partitionBytes;
 
   // set cursor to the start of the partition
   VDI_file.seekg(openedPartitionStart);
@@ -319,10 +569,21 @@ void vdi::partitionOpen(int number) {
 // close the opened partition (only one can be opened at a time)
 void vdi::partitionClose() {
   openedPartition = 0;
+  openedPartitionInOrder = false;
   openedPartitionStart = 0;
   openedPartitionEnd = 0;
 }
 
+// throws if the opened partition is not stored in one piece and in order in the image file ('action' names the
+// cursor operation in the error)
+void vdi::checkPartitionInOrder(const char *action) const {
+  if (!openedPartitionInOrder) {
+    throw std::runtime_error("cannot " + std::string(action) + ", the " + image->format() + " image does not store " +
+                             "partition " + std::to_string(openedPartition) +
+                             " in order (the cursor only works on raw and fixed VDI images)");
+  }
+}
+
 // read 'size' amount bytes from the opened partition into buffer (starting at cursor)
 void vdi::partitionRead(char *buffer, std::streamsize size) {
   // check that a partition is opened
@@ -330,6 +591,9 @@ void vdi::partitionRead(char *buffer, std::streamsize size) {
     throw std::runtime_error("cannot read, no partition is opened");
   }
 
+  // check that the opened partition can be read through the cursor
+  checkPartitionInOrder("read");
+
   // check that the cursor is within the opened partition
   if (VDI_file.tellg() < openedPartitionStart || VDI_file.tellg() > openedPartitionEnd) {
     throw std::out_of_range("cannot read, cursor is out of bounds of the opened partition");
@@ -383,6 +647,9 @@ void vdi::partitionSeek(std::ios::pos_type position) {
     throw std::runtime_error("cannot seek, no partition is opened");
   }
 
+  // check that the opened partition can be read through the cursor
+  checkPartitionInOrder("seek");
+
   // check that the desired position is within the bounds of the opened partition
   if (position < openedPartitionStart || position > openedPartitionEnd) {
     throw std::out_of_range("cannot seek, the given position is outside the range of the opened partition");
@@ -400,8 +667,11 @@ void vdi::partitionSeek(std::ios::off_type offset, std::ios_base::seekdir direct
     throw std::runtime_error("cannot seek, no partition is opened");
   }
 
+  // check that the opened partition can be read through the cursor
+  checkPartitionInOrder("seek");
+
   // position to be moved to (after calculations)
-  uint32_t position = 0;
+  int64_t position = 0;
 
   // check that the desired position is within the bounds of the opened partition
   switch (direction) {
@@ -442,104 +712,176 @@ void vdi::partitionSeek(std::ios::off_type offset, std::ios_base::seekdir direct
 
 // sets the values in the superblock struct
 void vdi::setSuperblock() {
-  // temporary buffer for reading in superblock values
-  char buffer[4];
-
-  // move cursor to start of main superblock
-  partitionOpen(1);
-  partitionSeek(1024);
+  // the whole raw main superblock (1024 bytes into the partition, read like any other part of the disk)
+  char buffer[1024];
+  readAt(buffer, 1024, sizeof(buffer));
 
   // get inode count
-  partitionRead(buffer, 4);
   superblock.inodeCount = littleEndianToInt(buffer, 4);
 
   // get block count
-  partitionRead(buffer, 4);
-  superblock.blockCount = littleEndianToInt(buffer, 4);
+  superblock.blockCount = littleEndianToInt(buffer + 4, 4);
 
   // get reserved block count
-  partitionRead(buffer, 4);
-  superblock.reservedBlockCount = littleEndianToInt(buffer, 4);
+  superblock.reservedBlockCount = littleEndianToInt(buffer + 8, 4);
 
   // get free block count
-  partitionRead(buffer, 4);
-  superblock.freeBlockCount = littleEndianToInt(buffer, 4);
+  superblock.freeBlockCount = littleEndianToInt(buffer + 12, 4);
 
   // get free inode count
-  partitionRead(buffer, 4);
-  superblock.freeInodeCount = littleEndianToInt(buffer, 4);
+  superblock.freeInodeCount = littleEndianToInt(buffer + 16, 4);
 
   // get first data block
-  partitionRead(buffer, 4);
-  superblock.firstDataBlock = littleEndianToInt(buffer, 4);
+  superblock.firstDataBlock = littleEndianToInt(buffer + 20, 4);
 
   // get log block size
-  partitionRead(buffer, 4);
-  superblock.logBlockSize = littleEndianToInt(buffer, 4);
+  superblock.logBlockSize = littleEndianToInt(buffer + 24, 4);
 
   // get log fragment size
-  partitionRead(buffer, 4);
-  superblock.logFragmentSize = littleEndianToInt(buffer, 4);
+  superblock.logFragmentSize = littleEndianToInt(buffer + 28, 4);
 
   // get blocks per group
-  partitionRead(buffer, 4);
-  superblock.blocksPerGroup = littleEndianToInt(buffer, 4);
+  superblock.blocksPerGroup = littleEndianToInt(buffer + 32, 4);
 
   // get fragments per group
-  partitionRead(buffer, 4);
-  superblock.fragmentsPerGroup = littleEndianToInt(buffer, 4);
+  superblock.fragmentsPerGroup = littleEndianToInt(buffer + 36, 4);
 
   // get inodes per group
-  partitionRead(buffer, 4);
-  superblock.inodesPerGroup = littleEndianToInt(buffer, 4);
+  superblock.inodesPerGroup = littleEndianToInt(buffer + 40, 4);
 
   // get magic number
-  partitionSeek(12, std::ios::cur);
-  partitionRead(buffer, 2);
-  superblock.magicNumber = littleEndianToInt(buffer, 2);
+  superblock.magicNumber = littleEndianToInt(buffer + 56, 2);
 
   // check that the magic number is correct
   if (superblock.magicNumber != 0xef53) {
-    throw std::runtime_error("invalid ext2 superblock (magic number does not match)");
+    throw std::runtime_error("invalid ext2 superblock (magic number does not match), " +
+                             describePartition(filesystemPartition) + " does not hold an ext2/3/4 filesystem");
   }
 
   // get state
-  partitionRead(buffer, 2);
-  superblock.state = littleEndianToInt(buffer, 2);
+  superblock.state = littleEndianToInt(buffer + 58, 2);
 
   // get first inode number
-  partitionSeek(24, std::ios::cur);
-  partitionRead(buffer, 4);
-  superblock.firstInodeNumber = littleEndianToInt(buffer, 4);
+  superblock.firstInodeNumber = littleEndianToInt(buffer + 84, 4);
 
   // get inode size
-  partitionRead(buffer, 2);
-  superblock.inodeSize = littleEndianToInt(buffer, 2);
+  superblock.inodeSize = littleEndianToInt(buffer + 88, 2);
+
+  // get compatible feature flags (features a reader can ignore, like the HTree indexes of large directories)
+  superblock.featureCompat = littleEndianToInt(buffer + 92, 4);
+
+  // get incompatible feature flags (features a reader has to understand to read the filesystem correctly)
+  superblock.featureIncompat = littleEndianToInt(buffer + 96, 4);
+  if (superblock.featureIncompat & ~supportedIncompat) {
+    std::ostringstream unsupported;
+    unsupported << std::hex << (superblock.featureIncompat & ~supportedIncompat);
+    throw std::runtime_error("filesystem uses unsupported incompatible features (0x" + unsupported.str() + ")");
+  }
+
+  // get block group descriptor size (32 bytes unless the filesystem has the 64-bit feature)
+  superblock.descSize = 32;
+  if ((superblock.featureIncompat & incompat64Bit) && littleEndianToInt(buffer + 254, 2) >= 32) {
+    superblock.descSize = littleEndianToInt(buffer + 254, 2);
+  }
+
+  // get directory hash seed (all zeros = use the default seed)
+  for (uint32_t i = 0; i < 4; ++i) {
+    superblock.hashSeed[i] = littleEndianToInt(buffer + 236 + i * 4, 4);
+  }
+
+  // get flags (signed or unsigned directory hashes)
+  superblock.flags = littleEndianToInt(buffer + 352, 4);
 
   // get block size
   superblock.blockSize = (uint32_t)1024 << superblock.logBlockSize;
 
   // get block group count
   superblock.blockGroupCount = ceil((double)superblock.blockCount / (double)superblock.blocksPerGroup);
+}
 
-  // close the partition
-  partitionClose();
+// get the byte location of the desired block number inside the partition
+uint64_t vdi::locateBlock(uint32_t blockNum) const {
+  return ((uint64_t)blockNum + superblock.firstDataBlock) * superblock.blockSize;
+}
+
+// get the contents of the block indicated by 'blockNum' out of the block cache (read from disk only on a miss)
+std::shared_ptr<const std::vector<char>> vdi::cachedBlock(uint32_t blockNum) {
+  std::shared_ptr<const std::vector<char>> block;
+
+  // block was read before
+  if (blockCache.get(blockNum, block)) {
+    return block;
+  }
+
+  // read the block from disk and keep it for later
+  auto contents = std::make_shared<std::vector<char>>(superblock.blockSize);
+  readAt(contents->data(), locateBlock(blockNum), superblock.blockSize);
+  blockCache.put(blockNum, contents);
+
+  return contents;
 }
 
-// get the VDI file's byte location of the desired block number
-uint32_t vdi::locateBlock(uint32_t blockNum) const {
-  return (blockNum * superblock.blockSize) + (superblock.firstDataBlock * superblock.blockSize);
+// get a pointer to 'size' bytes starting at byte 'position' inside the virtual disk
+// (points straight into the mapping with the mmap backend, otherwise reads into 'buffer' and returns it)
+// note: ranges inside a single block are served from the block cache
+const char *vdi::view(char *buffer, uint64_t position, uint32_t size) {
+  if (mappedFile != NULL) {
+    // find the bytes in the file (offset position to start at the beginning of the partition)
+    uint32_t length = size;
+    uint64_t start;
+    if (!image->locate(partitionStart + position, length, start) || length < size) {
+      // unallocated or split over two pieces of the image, put it together in the buffer
+      readAt(buffer, position, size);
+      return buffer;
+    }
+
+    // check that the requested bytes are inside the mapping
+    if (start + size > source->size()) {
+      throw std::out_of_range("cannot view bytes, the requested range is outside of the VDI file");
+    }
+
+    // no copy needed, hand out a pointer into the mapping
+    return mappedFile + start;
+  }
+
+  // offset of the range within its block
+  uint32_t offset = position % superblock.blockSize;
+
+  if (offset + size <= superblock.blockSize && blockCache.capacity() > 0) {
+    // range fits inside one block, copy it out of the cached block
+    // (undo the 'firstDataBlock' offset that 'locateBlock' adds to get the block number back)
+    std::shared_ptr<const std::vector<char>> block =
+        cachedBlock(position / superblock.blockSize - superblock.firstDataBlock);
+    memcpy(buffer, block->data() + offset, size);
+  } else {
+    // read into the buffer without touching the file cursor
+    readAt(buffer, position, size);
+  }
+
+  return buffer;
 }
 
 // read the block indicated by 'blockNum' into the buffer (buffer must be at least size 'superblock.blockSize')
+// note: blocks are kept in an LRU block cache, so repeated metadata reads don't go to disk
 void vdi::fetchBlock(char *buffer, uint32_t blockNum) {
-  // set file cursor to the start of the desired block
-  seek(locateBlock(blockNum));
-
-  // read block into buffer
-  read(buffer, superblock.blockSize);
+  if (mappedFile != NULL) {
+    // the mapping already acts as a cache, copy straight out of it
+    memcpy(buffer, view(buffer, locateBlock(blockNum), superblock.blockSize), superblock.blockSize);
+  } else if (blockCache.capacity() > 0) {
+    // copy the block out of the cache
+    memcpy(buffer, cachedBlock(blockNum)->data(), superblock.blockSize);
+  } else {
+    // cache disabled, read straight into the buffer
+    readAt(buffer, locateBlock(blockNum), superblock.blockSize);
+  }
 }
 
+// set how many blocks the block cache holds at once (0 disables the cache, default is 1024)
+void vdi::setBlockCacheCapacity(size_t capacity) { blockCache.setCapacity(capacity); }
+
+// get the hit and miss counts of the block cache
+vdi::cacheStats vdi::blockCacheStats() const { return {blockCache.hits(), blockCache.misses()}; }
+
 // write the contents of the buffer into the block indicated by 'blockNum'
 // (buffer cannot be bigger than 'superblock.blockSize')
 // TODO: unused function, commented out for now
@@ -553,23 +895,22 @@ void vdi::fetchBlock(char *buffer, uint32_t blockNum) {
 
 // read the superblock into the supplied structure at the specified block number
 void vdi::fetchSuperblock(struct vdi::superblock &sb, uint32_t blockNum) {
-  // temporary buffer for reading in superblock values
-  char buffer[4];
+  // temporary buffer for reading in the superblock (unused with the mmap backend)
+  char buffer[1024];
 
   // calculate the start of the desired block
-  uint32_t blockStart = locateBlock(blockNum);
+  uint64_t blockStart = locateBlock(blockNum);
   if (blockNum == 0 && superblock.firstDataBlock == 0) {
     // attempting to get main superblock of non-1kb system
     // move block start another kb to reach superblock start
     blockStart += 1024;
   }
 
-  // skip file cursor to the magic number (for error checking)
-  seek(blockStart + 56);
+  // get the raw superblock in a single read (or straight from the mapping)
+  const char *raw = view(buffer, blockStart, sizeof(buffer));
 
   // get magic number
-  read(buffer, 2);
-  sb.magicNumber = littleEndianToInt(buffer, 2);
+  sb.magicNumber = littleEndianToInt(raw + 56, 2);
 
   // check that the magic number is correct
   if (sb.magicNumber != superblock.magicNumber) {
@@ -577,68 +918,64 @@ void vdi::fetchSuperblock(struct vdi::superblock &sb, uint32_t blockNum) {
         "cannot fetch superblock, block does not contain a superblock (magic number does not match)");
   }
 
-  // move cursor back to the start of the block
-  seek(blockStart);
-
   // get inode count
-  read(buffer, 4);
-  sb.inodeCount = littleEndianToInt(buffer, 4);
+  sb.inodeCount = littleEndianToInt(raw, 4);
 
   // get block count
-  read(buffer, 4);
-  sb.blockCount = littleEndianToInt(buffer, 4);
+  sb.blockCount = littleEndianToInt(raw + 4, 4);
 
   // get reserved block count
-  read(buffer, 4);
-  sb.reservedBlockCount = littleEndianToInt(buffer, 4);
+  sb.reservedBlockCount = littleEndianToInt(raw + 8, 4);
 
   // get free block count
-  read(buffer, 4);
-  sb.freeBlockCount = littleEndianToInt(buffer, 4);
+  sb.freeBlockCount = littleEndianToInt(raw + 12, 4);
 
   // get free inode count
-  read(buffer, 4);
-  sb.freeInodeCount = littleEndianToInt(buffer, 4);
+  sb.freeInodeCount = littleEndianToInt(raw + 16, 4);
 
   // get first data block
-  read(buffer, 4);
-  sb.firstDataBlock = littleEndianToInt(buffer, 4);
+  sb.firstDataBlock = littleEndianToInt(raw + 20, 4);
 
   // get log block size
-  read(buffer, 4);
-  sb.logBlockSize = littleEndianToInt(buffer, 4);
+  sb.logBlockSize = littleEndianToInt(raw + 24, 4);
 
   // get log fragment size
-  read(buffer, 4);
-  sb.logFragmentSize = littleEndianToInt(buffer, 4);
+  sb.logFragmentSize = littleEndianToInt(raw + 28, 4);
 
   // get blocks per group
-  read(buffer, 4);
-  sb.blocksPerGroup = littleEndianToInt(buffer, 4);
+  sb.blocksPerGroup = littleEndianToInt(raw + 32, 4);
 
   // get fragments per group
-  read(buffer, 4);
-  sb.fragmentsPerGroup = littleEndianToInt(buffer, 4);
+  sb.fragmentsPerGroup = littleEndianToInt(raw + 36, 4);
 
   // get inodes per group
-  read(buffer, 4);
-  sb.inodesPerGroup = littleEndianToInt(buffer, 4);
-
-  // magic number already read, skip to state
-  seek(14, std::ios::cur);
+  sb.inodesPerGroup = littleEndianToInt(raw + 40, 4);
 
   // get state
-  read(buffer, 2);
-  sb.state = littleEndianToInt(buffer, 2);
+  sb.state = littleEndianToInt(raw + 58, 2);
 
   // get first inode number
-  seek(24, std::ios::cur);
-  read(buffer, 4);
-  sb.firstInodeNumber = littleEndianToInt(buffer, 4);
+  sb.firstInodeNumber = littleEndianToInt(raw + 84, 4);
 
   // get inode size
-  read(buffer, 2);
-  sb.inodeSize = littleEndianToInt(buffer, 2);
+  sb.inodeSize = littleEndianToInt(raw + 88, 2);
+
+  // get compatible and incompatible feature flags
+  sb.featureCompat = littleEndianToInt(raw + 92, 4);
+  sb.featureIncompat = littleEndianToInt(raw + 96, 4);
+
+  // get directory hash seed
+  for (uint32_t i = 0; i < 4; ++i) {
+    sb.hashSeed[i] = littleEndianToInt(raw + 236 + i * 4, 4);
+  }
+
+  // get flags
+  sb.flags = littleEndianToInt(raw + 352, 4);
+
+  // get block group descriptor size
+  sb.descSize = (sb.featureIncompat & incompat64Bit) && littleEndianToInt(raw + 254, 2) >= 32
+                    ? littleEndianToInt(raw + 254, 2)
+                    : 32;
 
   // get block size
   sb.blockSize = (uint32_t)1024 << sb.logBlockSize;
@@ -746,43 +1083,43 @@ void vdi::fetchBGDT(struct vdi::blockGroupDescriptorTable *bgdt, uint32_t blockN
     throw std::runtime_error("cannot fetch BGDT, block does not contain a BGDT (no superblock in the block before it)");
   }
 
-  // temporary buffer for reading in BGDT values
-  char buffer[4];
+  // size of a single row of the table (64 bytes or more on filesystems with the 64-bit feature)
+  const uint32_t rowSize = superblock.descSize;
 
-  // calculate the start of the desired block
-  uint32_t blockStart = locateBlock(blockNum);
+  // temporary buffer for reading in the whole table (unused with the mmap backend)
+  std::vector<char> buffer((size_t)superblock.blockGroupCount * rowSize);
 
-  // move cursor to the start of the block
-  seek(blockStart);
+  // get the raw table in a single read (or straight from the mapping)
+  const char *raw = view(buffer.data(), locateBlock(blockNum), buffer.size());
 
   // loop through each row of the table
-  for (uint32_t i = 0; i < superblock.blockGroupCount; ++i) {
+  for (uint32_t i = 0; i < superblock.blockGroupCount; ++i, raw += rowSize) {
     // get block bitmap
-    read(buffer, 4);
-    bgdt[i].blockBitmap = littleEndianToInt(buffer, 4);
+    bgdt[i].blockBitmap = littleEndianToInt(raw, 4);
 
     // get inode bitmap
-    read(buffer, 4);
-    bgdt[i].inodeBitmap = littleEndianToInt(buffer, 4);
+    bgdt[i].inodeBitmap = littleEndianToInt(raw + 4, 4);
 
     // get inode table
-    read(buffer, 4);
-    bgdt[i].inodeTable = littleEndianToInt(buffer, 4);
+    bgdt[i].inodeTable = littleEndianToInt(raw + 8, 4);
 
     // get free blocks count
-    read(buffer, 2);
-    bgdt[i].freeBlocksCount = littleEndianToInt(buffer, 2);
+    bgdt[i].freeBlocksCount = littleEndianToInt(raw + 12, 2);
 
     // get free inodes count
-    read(buffer, 2);
-    bgdt[i].freeInodesCount = littleEndianToInt(buffer, 2);
+    bgdt[i].freeInodesCount = littleEndianToInt(raw + 14, 2);
 
     // get used directories count
-    read(buffer, 2);
-    bgdt[i].usedDirsCount = littleEndianToInt(buffer, 2);
+    bgdt[i].usedDirsCount = littleEndianToInt(raw + 16, 2);
+
+    // get flags (ext4 leaves the inode bitmap and table of groups without used inodes uninitialized)
+    bgdt[i].flags = littleEndianToInt(raw + 18, 2);
 
-    // skip cursor to next row
-    seek(14, std::ios::cur);
+    // the high halves of the block numbers (64-bit descriptors only, block numbers are 32 bits wide here)
+    if (rowSize >= 64 &&
+        (littleEndianToInt(raw + 32, 4) | littleEndianToInt(raw + 36, 4) | littleEndianToInt(raw + 40, 4)) != 0) {
+      throw std::runtime_error("cannot fetch BGDT, block numbers above 32 bits are not supported");
+    }
   }
 }
 
@@ -846,78 +1183,175 @@ void vdi::fetchInode(vdi::inode &in, uint32_t iNum) {
     throw std::invalid_argument("cannot fetch inode, inode number cannot be zero");
   }
 
+  // already decoded by an earlier lookup (of this inode or one stored in the same block)
+  if (inodeCache.get(iNum, in)) {
+    return;
+  }
+
   // calculate block group that the inode belongs to
   uint32_t blockGroup = (iNum - 1) / superblock.inodesPerGroup;
 
   // calculate local inode index within that block group
   uint32_t localIndex = (iNum - 1) % superblock.inodesPerGroup;
 
-  // move cursor to the start of the desired inode
-  seek(locateBlock(bgdt[blockGroup].inodeTable - superblock.firstDataBlock) + (localIndex * superblock.inodeSize));
+  // number of inodes stored in a single block of the inode table
+  uint32_t inodesPerBlock = superblock.blockSize / superblock.inodeSize;
+
+  // local index of the first inode stored in the same block as the requested one
+  uint32_t firstIndex = localIndex - localIndex % inodesPerBlock;
 
-  // temporary buffer for reading in inode values
-  char buffer[4];
+  // temporary buffer for reading in the inode table block (unused with the mmap backend)
+  std::vector<char> buffer(superblock.blockSize);
 
+  // get the whole inode table block holding the inode in a single read (or straight from the mapping)
+  const char *raw =
+      view(buffer.data(),
+           locateBlock(bgdt[blockGroup].inodeTable + localIndex / inodesPerBlock - superblock.firstDataBlock),
+           superblock.blockSize);
+
+  // decode every inode in the block (neighbouring inodes are usually needed next)
+  for (uint32_t i = firstIndex; i < firstIndex + inodesPerBlock && i < superblock.inodesPerGroup; ++i) {
+    inode decoded{};
+    decodeInode(raw + (i - firstIndex) * superblock.inodeSize, decoded);
+    inodeCache.put(blockGroup * superblock.inodesPerGroup + i + 1, decoded);
+
+    // hand the requested inode to the caller
+    if (i == localIndex) {
+      in = decoded;
+    }
+  }
+}
+
+// read every in-use inode of the filesystem into 'inodes' with one sequential pass over each block group
+// (the inode bitmap of a group says which inodes are in use, its inode table is read in large pieces in disk order)
+void vdi::scanInodes(vdi::inodeSet &inodes) {
+  inodes.slot.assign((size_t)superblock.inodeCount + 1, 0);
+  inodes.inodes.clear();
+
+  // largest number of inode table bytes read at once (larger tables are read in pieces of this size)
+  const uint32_t maxChunk = 16 << 20;
+
+  // buffers for the inode bitmap and the pieces of the inode table
+  std::vector<char> bitmapBuffer(superblock.blockSize);
+  std::vector<char> tableBuffer;
+
+  for (uint32_t group = 0; group < superblock.blockGroupCount; ++group) {
+    // no inode of the group was ever used, its bitmap and table may hold anything
+    if (bgdt[group].flags & inodeUninit) {
+      continue;
+    }
+
+    // get the inode bitmap of the group (bit n of the bitmap is set when local inode n is in use)
+    const char *bitmap = view(bitmapBuffer.data(), locateBlock(bgdt[group].inodeBitmap - superblock.firstDataBlock),
+                              superblock.blockSize);
+
+    // only read the inode table up to the last inode in use
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < superblock.inodesPerGroup; ++i) {
+      if (bitmap[i / 8] & (1 << (i % 8))) {
+        used = i + 1;
+      }
+    }
+
+    uint64_t tableStart = locateBlock(bgdt[group].inodeTable - superblock.firstDataBlock);
+    uint64_t tableBytes = (uint64_t)used * superblock.inodeSize;
+
+    for (uint64_t done = 0; done < tableBytes;) {
+      // read whole inodes only
+      uint32_t chunk = std::min((uint64_t)maxChunk / superblock.inodeSize * superblock.inodeSize, tableBytes - done);
+      tableBuffer.resize(std::max((size_t)chunk, tableBuffer.size()));
+      readAt(tableBuffer.data(), tableStart + done, chunk);
+
+      // decode the inodes in use
+      for (uint32_t offset = 0; offset < chunk; offset += superblock.inodeSize) {
+        uint32_t local = (done + offset) / superblock.inodeSize;
+        if (!(bitmap[local / 8] & (1 << (local % 8)))) {
+          continue;
+        }
+
+        inode decoded{};
+        decodeInode(tableBuffer.data() + offset, decoded);
+        inodes.inodes.push_back(decoded);
+        inodes.slot[group * superblock.inodesPerGroup + local + 1] = inodes.inodes.size();
+      }
+
+      done += chunk;
+    }
+  }
+}
+
+// set how many decoded inodes the inode cache holds at once (0 disables the cache, default is 8192)
+void vdi::setInodeCacheCapacity(size_t capacity) { inodeCache.setCapacity(capacity); }
+
+// get the hit and miss counts of the inode cache
+vdi::cacheStats vdi::inodeCacheStats() const { return {inodeCache.hits(), inodeCache.misses()}; }
+
+// decode the raw on-disk inode starting at 'raw' into an inode structure
+void vdi::decodeInode(const char *raw, vdi::inode &in) {
   // get mode
-  read(buffer, 2);
-  in.mode = littleEndianToInt(buffer, 2);
+  in.mode = littleEndianToInt(raw, 2);
 
   // get user id
-  read(buffer, 2);
-  in.uid = littleEndianToInt(buffer, 2);
+  in.uid = littleEndianToInt(raw + 2, 2);
 
-  // get size
-  read(buffer, 4);
-  in.size = littleEndianToInt(buffer, 4);
+  // get size (the high 32 bits of a regular file's size are stored separately, see below)
+  in.size = littleEndianToInt(raw + 4, 4);
 
   // get accessed time
-  read(buffer, 4);
-  in.atime = littleEndianToInt(buffer, 4);
+  in.atime = littleEndianToInt(raw + 8, 4);
 
   // get created time
-  read(buffer, 4);
-  in.ctime = littleEndianToInt(buffer, 4);
+  in.ctime = littleEndianToInt(raw + 12, 4);
 
   // get modified time
-  read(buffer, 4);
-  in.mtime = littleEndianToInt(buffer, 4);
+  in.mtime = littleEndianToInt(raw + 16, 4);
 
   // get deleted time
-  read(buffer, 4);
-  in.dtime = littleEndianToInt(buffer, 4);
+  in.dtime = littleEndianToInt(raw + 20, 4);
 
   // get group id
-  read(buffer, 2);
-  in.gid = littleEndianToInt(buffer, 2);
+  in.gid = littleEndianToInt(raw + 24, 2);
 
   // get links count
-  read(buffer, 2);
-  in.linksCount = littleEndianToInt(buffer, 2);
+  in.linksCount = littleEndianToInt(raw + 26, 2);
 
   // get 'blocks' (total number of 512-bytes blocks reserved to contain the data of this inode)
   // note: maximum index of the 'block' array is computed with: blocks / (2 << superblock.logBlockSize)
-  read(buffer, 4);
-  in.blocks = littleEndianToInt(buffer, 4);
+  in.blocks = littleEndianToInt(raw + 28, 4);
 
   // get flags
   // note: flag definition table: https://www.nongnu.org/ext2-doc/ext2.html#i-flags
-  read(buffer, 4);
-  in.flags = littleEndianToInt(buffer, 4);
+  in.flags = littleEndianToInt(raw + 32, 4);
 
   // get the block array (15 4-byte values)
-  seek(4, std::ios::cur);
-  for (uint32_t &i : in.block) {
-    read(buffer, 4);
-    i = littleEndianToInt(buffer, 4);
+  for (uint32_t i = 0; i < 15; ++i) {
+    in.block[i] = littleEndianToInt(raw + 40 + i * 4, 4);
   }
 
   // get file version
-  read(buffer, 4);
-  in.generation = littleEndianToInt(buffer, 4);
+  in.generation = littleEndianToInt(raw + 100, 4);
 
   // get ACL block
-  read(buffer, 4);
-  in.aclBlock = littleEndianToInt(buffer, 4);
+  in.aclBlock = littleEndianToInt(raw + 104, 4);
+
+  // get the high 32 bits of the size ('i_size_high', files of 4 GiB and up on filesystems with the large file feature)
+  // note: older revisions use the same field as the directory ACL block, so it only counts for regular files
+  if ((in.mode & 0xF000) == 0x8000) {
+    in.size |= littleEndianToInt(raw + 108, 4) << 32;
+  }
+}
+
+// get the record length of the raw directory entry starting at 'raw' (on 64K block filesystems a whole block is
+// stored as 65535 or 0 and the two low bits hold bit 16 and 17 of the length)
+uint32_t vdi::decodeRecLen(const char *raw) const {
+  uint32_t length = littleEndianToInt(raw + 4, 2);
+  if (superblock.blockSize < 65536) {
+    return length;
+  }
+  if (length == 65535 || length == 0) {
+    return 65536;
+  }
+  return (length & 65532) | ((length & 3) << 16);
 }
 
 // write the given inode structure at the specified inode index
@@ -1193,8 +1627,73 @@ void vdi::fetchInode(vdi::inode &in, uint32_t iNum) {
 // }
 
 // read the file block 'bNum' into a buffer of the file represented by the supplied inode
-// (buffer must be at least size 'superblock.blockSize')
+// (buffer must be at least size 'superblock.blockSize', holes are filled with zeros without reading anything)
 void vdi::fetchBlockFromFile(char *buffer, const vdi::inode &in, uint32_t bNum) {
+  uint32_t diskBlock = locateFileBlock(in, bNum);
+
+  // holes read back as zeros without touching the disk
+  if (diskBlock == 0) {
+    memset(buffer, 0, superblock.blockSize);
+    return;
+  }
+
+  // fetch the block into the buffer
+  fetchBlock(buffer, diskBlock - superblock.firstDataBlock);
+}
+
+// get the disk block number that holds the file block 'bNum' of the file represented by the supplied inode
+// note: returns 0 if the block is a hole (a zero entry in the block array or in any indirect block above it)
+uint32_t vdi::locateFileBlock(const vdi::inode &in, uint32_t bNum) {
+  // ext4 extent tree, follow the index entries down to the leaf that covers the block
+  if (in.flags & extentsFlag) {
+    // the root node is searched in place in the inode's block array (no decoding or allocation on every lookup)
+    char root[sizeof(in.block)];
+    packExtentRoot(in, root);
+    uint16_t rootCount = checkExtentHeader(root, sizeof(root)), rootDepth = littleEndianToInt(root + 6, 2);
+
+    // last entry starting at or before the block
+    uint16_t low = 0, high = rootCount;
+    while (low < high) {
+      uint16_t middle = (low + high) / 2;
+      if (littleEndianToInt(root + 12 + middle * 12, 4) > bNum) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+    if (low == 0) {
+      return 0;
+    }
+    extent rootEntry{};
+    decodeExtentEntry(root + 12 + (low - 1) * 12, rootDepth, rootEntry);
+
+    if (rootDepth == 0) {
+      // past the end of the extent (or an uninitialized extent) is a hole
+      return bNum - rootEntry.logical < rootEntry.length && rootEntry.physical != 0
+                 ? rootEntry.physical + (bNum - rootEntry.logical)
+                 : 0;
+    }
+
+    // the nodes below the root come out of the extent cache
+    std::shared_ptr<const extentNode> node = fetchExtentNode(rootEntry.physical, rootDepth - 1);
+    while (true) {
+      // last entry starting at or before the block
+      auto next = std::upper_bound(node->entries.begin(), node->entries.end(), bNum,
+                                   [](uint32_t b, const extent &e) { return b < e.logical; });
+      if (next == node->entries.begin()) {
+        return 0;
+      }
+      const extent &entry = *(next - 1);
+
+      if (node->depth == 0) {
+        // past the end of the extent (or an uninitialized extent) is a hole
+        return bNum - entry.logical < entry.length && entry.physical != 0 ? entry.physical + (bNum - entry.logical) : 0;
+      }
+
+      node = fetchExtentNode(entry.physical, node->depth - 1);
+    }
+  }
+
   // array length of the inode indirect blocks
   uint32_t k = superblock.blockSize / 4;
 
@@ -1210,146 +1709,745 @@ void vdi::fetchBlockFromFile(char *buffer, const vdi::inode &in, uint32_t bNum)
   } else if (bNum < 12 + k) {
     /* data block is stored in the single indirect block */
 
-    // error checking
+    // a missing SIB is a hole over all of its blocks
     if (in.block[12] == 0) {
-      throw std::range_error("cannot fetch file block, desired block number doesn't exist");
+      return 0;
     }
 
-    // move file cursor to the start of the SIB
-    seek(locateBlock(in.block[12] - superblock.firstDataBlock));
-
     // offset the file block number
     bNum -= 12;
 
-    // move file cursor forward in the SIB array to the start of the desired file block number
-    seek(bNum * 4, std::ios::cur);
-
-    // temporary buffer for holding the array value
-    char temp[4];
-
-    // read the value, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
+    // the disk block number is the value at index 'bNum' of the SIB array
+    diskBlock = (*fetchIndirect(in.block[12]))[bNum];
   } else if (bNum < 12 + k + k * k) {
     /* data block is stored in the double indirect block */
 
-    // error checking
+    // a missing DIB is a hole over all of its blocks
     if (in.block[13] == 0) {
-      throw std::range_error("cannot fetch file block, desired block number doesn't exist");
+      return 0;
     }
 
-    // move file cursor to the start of the DIB
-    seek(locateBlock(in.block[13] - superblock.firstDataBlock));
-
     // offset the file block number (for calculating SIB index)
     bNum = bNum - 12 - k;
 
-    // get the index of the correct SIB
-    uint32_t SIB_index = bNum / k;
-
-    // move file cursor to that SIB
-    seek(SIB_index * 4, std::ios::cur);
-
-    // temporary buffer for holding the array value
-    char temp[4];
-
-    // read the SIB block number, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
-
-    // move the file cursor to the SIB block
-    seek(locateBlock(diskBlock - superblock.firstDataBlock));
-
-    // offset the file block number again (for calculating index within the SIB)
-    bNum = bNum % k;
-
-    // move file cursor forward in the SIB array to the start of the desired file block number
-    seek(bNum * 4, std::ios::cur);
+    // get the SIB block number out of the DIB array
+    diskBlock = (*fetchIndirect(in.block[13]))[bNum / k];
+    if (diskBlock == 0) {
+      return 0;
+    }
 
-    // read the value, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
+    // the disk block number is the value at the index within the SIB array
+    diskBlock = (*fetchIndirect(diskBlock))[bNum % k];
   } else {
     /* data block is stored in the triple indirect block */
 
-    // error checking
+    // a missing TIB is a hole over all of its blocks
     if (in.block[14] == 0) {
-      throw std::range_error("cannot fetch file block, desired block number doesn't exist");
+      return 0;
     }
 
-    // move file cursor to the start of the TIB
-    seek(locateBlock(in.block[14] - superblock.firstDataBlock));
-
     // offset the file block number (for calculating TIB index)
     bNum = bNum - 12 - k - k * k;
 
-    // get the index of the correct TIB
-    uint32_t TIB_index = bNum / (k * k);
+    // get the DIB block number out of the TIB array
+    diskBlock = (*fetchIndirect(in.block[14]))[bNum / (k * k)];
+    if (diskBlock == 0) {
+      return 0;
+    }
+
+    // get the SIB block number out of the DIB array
+    diskBlock = (*fetchIndirect(diskBlock))[(bNum / k) % k];
+    if (diskBlock == 0) {
+      return 0;
+    }
+
+    // the disk block number is the value at the index within the SIB array
+    diskBlock = (*fetchIndirect(diskBlock))[bNum % k];
+  }
 
-    // move file cursor to that TIB
-    seek(TIB_index * 4, std::ios::cur);
+  return diskBlock;
+}
 
-    // temporary buffer for holding the array value
-    char temp[4];
+// get the decoded array of block numbers stored in the indirect block 'blockNum' (read from disk only on a miss)
+std::shared_ptr<const std::vector<uint32_t>> vdi::fetchIndirect(uint32_t blockNum) {
+  std::shared_ptr<const std::vector<uint32_t>> decoded;
 
-    // read the DIB block number, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
+  // already decoded by an earlier lookup
+  if (indirectCache.get(blockNum, decoded)) {
+    return decoded;
+  }
 
-    // move the file cursor to the DIB block
-    seek(locateBlock(diskBlock - superblock.firstDataBlock));
+  // read the raw indirect block
+  std::vector<char> block(superblock.blockSize);
+  fetchBlock(block.data(), blockNum - superblock.firstDataBlock);
 
-    // get the index of the correct SIB
-    uint32_t SIB_index = bNum / k;
+  decoded = decodeIndirect(block.data());
+  indirectCache.put(blockNum, decoded);
 
-    // move file cursor to that SIB
-    seek(SIB_index * 4, std::ios::cur);
+  return decoded;
+}
 
-    // read the SIB block number, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
+// decode the raw indirect block starting at 'raw' into an array of block numbers
+std::shared_ptr<const std::vector<uint32_t>> vdi::decodeIndirect(const char *raw) const {
+  // convert every array value to an int
+  auto entries = std::make_shared<std::vector<uint32_t>>(superblock.blockSize / 4);
+  for (uint32_t i = 0; i < entries->size(); ++i) {
+    (*entries)[i] = littleEndianToInt(raw + i * 4, 4);
+  }
 
-    // move the file cursor to the SIB block
-    seek(locateBlock(diskBlock - superblock.firstDataBlock));
+  return entries;
+}
 
-    // offset the file block number again (for calculating index within the SIB)
-    bNum = bNum % k;
+// read the 'count' indirect blocks listed at 'blockNums' into the indirect cache with one batch on the read engine
+// (zero entries are holes and blocks that are already cached are kept as they are, both are skipped)
+void vdi::prefetchIndirect(const uint32_t *blockNums, size_t count) {
+  // the blocks that are not cached yet
+  std::vector<uint32_t> fetched;
+  for (size_t i = 0; i < count; ++i) {
+    if (blockNums[i] != 0 && !indirectCache.touch(blockNums[i])) {
+      fetched.push_back(blockNums[i]);
+    }
+  }
+  if (fetched.empty()) {
+    return;
+  }
 
-    // move file cursor forward in the SIB array to the start of the desired file block number
-    seek(bNum * 4, std::ios::cur);
+  // one buffer for all of the blocks
+  std::vector<char> buffer(fetched.size() * superblock.blockSize);
 
-    // read the value, convert to int, and save it as the disk block number
-    read(temp, 4);
-    diskBlock = littleEndianToInt(temp, 4);
+  std::vector<readEngine::request> requests;
+  for (size_t i = 0; i < fetched.size(); ++i) {
+    requests.push_back({buffer.data() + i * superblock.blockSize, locateBlock(fetched[i] - superblock.firstDataBlock),
+                        superblock.blockSize});
   }
 
-  /* disk block number has been calculated at this point, ready for reading */
+  readBatch(requests.data(), requests.size());
 
-  // fetch the block into the buffer
-  fetchBlock(buffer, diskBlock - superblock.firstDataBlock);
+  for (size_t i = 0; i < fetched.size(); ++i) {
+    indirectCache.put(fetched[i], decodeIndirect(buffer.data() + i * superblock.blockSize));
+  }
 }
 
-// write the supplied buffer into the file block 'bNum' of the file represented by the supplied inode
-// (buffer must be at least size 'superblock.blockSize')
-// TODO: not implemented, come back to this at the end if there is enough time
-// void vdi::writeBlockToFile(const char *buffer, vdi::inode &in, uint32_t bNum) {}
+// set how many decoded indirect blocks are cached at once (0 disables the cache, default is 64)
+void vdi::setIndirectCacheCapacity(size_t capacity) { indirectCache.setCapacity(capacity); }
 
-// open the directory with the given inode number and return a pointer to the directory struct
-vdi::directory *vdi::openDir(uint32_t iNum) {
-  // create new directory pointer
-  auto *d = new directory;
+// decode the root node of the extent tree stored in the block array of the supplied inode
+std::shared_ptr<const vdi::extentNode> vdi::rootExtentNode(const vdi::inode &in) const {
+  char raw[sizeof(in.block)];
+  packExtentRoot(in, raw);
 
-  // fill out directory struct fields
-  fetchInode(d->in, iNum);
-  d->iNum = iNum;
-  d->block = new char[superblock.blockSize];
+  return decodeExtentNode(raw, sizeof(raw));
+}
 
-  // return directory pointer
-  return d;
+// copy the raw root node of the extent tree out of the block array of the supplied inode into 'raw' (60 bytes)
+// (the block array holds the node's header and up to 4 entries)
+void vdi::packExtentRoot(const vdi::inode &in, char *raw) {
+  for (uint32_t i = 0; i < 15; ++i) {
+    for (uint32_t j = 0; j < 4; ++j) {
+      raw[i * 4 + j] = static_cast<char>(in.block[i] >> (j * 8));
+    }
+  }
 }
 
-// fetch the next directory entry inside the given directory
-// fill the inode number and name of the entry into 'iNum' and 'name'
+// get the decoded extent tree node stored in block 'blockNum', which has to be at depth 'depth' of its tree
+// (read from disk only on a miss)
+std::shared_ptr<const vdi::extentNode> vdi::fetchExtentNode(uint32_t blockNum, uint16_t depth) {
+  std::shared_ptr<const extentNode> decoded;
+
+  // already decoded by an earlier lookup
+  if (!extentCache.get(blockNum, decoded)) {
+    // read the raw node
+    std::vector<char> block(superblock.blockSize);
+    fetchBlock(block.data(), blockNum - superblock.firstDataBlock);
+
+    decoded = decodeExtentNode(block.data(), superblock.blockSize);
+    extentCache.put(blockNum, decoded);
+  }
+
+  // a node at the wrong depth would make the walk loop or stop early
+  if (decoded->depth != depth) {
+    throw std::runtime_error("corrupt extent tree, node in block " + std::to_string(blockNum) + " is at depth " +
+                             std::to_string(decoded->depth) + " instead of " + std::to_string(depth));
+  }
+
+  return decoded;
+}
+
+// decode the raw extent tree node of 'size' bytes starting at 'raw' (a header followed by index or leaf entries)
+std::shared_ptr<const vdi::extentNode> vdi::decodeExtentNode(const char *raw, uint32_t size) const {
+  uint16_t entryCount = checkExtentHeader(raw, size);
+
+  auto node = std::make_shared<extentNode>();
+  node->depth = littleEndianToInt(raw + 6, 2);
+  node->entries.resize(entryCount);
+
+  for (uint16_t i = 0; i < entryCount; ++i) {
+    decodeExtentEntry(raw + 12 + i * 12, node->depth, node->entries[i]);
+  }
+
+  return node;
+}
+
+// check the header of the raw extent tree node of 'size' bytes starting at 'raw' and get its number of entries
+uint16_t vdi::checkExtentHeader(const char *raw, uint32_t size) {
+  // magic number, entry count within the space the node has
+  uint16_t entryCount = littleEndianToInt(raw + 2, 2);
+  if (littleEndianToInt(raw, 2) != 0xf30a || (entryCount + 1) * 12u > size) {
+    throw std::runtime_error("corrupt extent tree, node does not start with a valid extent header");
+  }
+
+  return entryCount;
+}
+
+// decode the raw 12-byte entry starting at 'raw' of an extent tree node at depth 'depth' into 'decoded'
+void vdi::decodeExtentEntry(const char *raw, uint16_t depth, vdi::extent &decoded) {
+  // first file block the entry covers
+  decoded.logical = littleEndianToInt(raw, 4);
+
+  if (depth > 0) {
+    // index entry: block of the node one level down (high 16 bits at 8, low 32 bits at 4)
+    decoded.physical = littleEndianToInt(raw + 4, 4);
+    decoded.length = 0;
+    if (littleEndianToInt(raw + 8, 2) != 0) {
+      throw std::runtime_error("cannot read extent tree, block numbers above 32 bits are not supported");
+    }
+  } else {
+    // leaf entry: length (over 32768 = uninitialized, reads as zeros) and first block (high 16 bits at 6, low at 8)
+    decoded.length = littleEndianToInt(raw + 4, 2);
+    decoded.physical = littleEndianToInt(raw + 8, 4);
+    if (littleEndianToInt(raw + 6, 2) != 0) {
+      throw std::runtime_error("cannot read extent tree, block numbers above 32 bits are not supported");
+    }
+    if (decoded.length > 32768) {
+      decoded.length -= 32768;
+      decoded.physical = 0;
+    }
+  }
+}
+
+// read the nodes the 'count' index entries starting at 'entries' point to into the extent cache with one batch on
+// the read engine (nodes that are already cached are kept as they are and skipped)
+void vdi::prefetchExtentNodes(const vdi::extent *entries, size_t count) {
+  // the nodes that are not cached yet
+  std::vector<uint32_t> fetched;
+  for (size_t i = 0; i < count; ++i) {
+    if (!extentCache.touch(entries[i].physical)) {
+      fetched.push_back(entries[i].physical);
+    }
+  }
+  if (fetched.empty()) {
+    return;
+  }
+
+  // one buffer for all of the nodes
+  std::vector<char> buffer(fetched.size() * superblock.blockSize);
+
+  std::vector<readEngine::request> requests;
+  for (size_t i = 0; i < fetched.size(); ++i) {
+    requests.push_back({buffer.data() + i * superblock.blockSize, locateBlock(fetched[i] - superblock.firstDataBlock),
+                        superblock.blockSize});
+  }
+
+  readBatch(requests.data(), requests.size());
+
+  for (size_t i = 0; i < fetched.size(); ++i) {
+    extentCache.put(fetched[i], decodeExtentNode(buffer.data() + i * superblock.blockSize, superblock.blockSize));
+  }
+}
+
+// set how many decoded extent tree nodes are cached at once (0 disables the cache, default is 64)
+void vdi::setExtentCacheCapacity(size_t capacity) { extentCache.setCapacity(capacity); }
+
+// write the supplied buffer into the file block 'bNum' of the file represented by the supplied inode
+// (buffer must be at least size 'superblock.blockSize')
+// TODO: not implemented, come back to this at the end if there is enough time
+// void vdi::writeBlockToFile(const char *buffer, vdi::inode &in, uint32_t bNum) {}
+
+// add the file blocks 'logical' onward stored at disk block 'physical' onward to the end of the run list
+// (extends the last run when both are contiguous, a physical block of 0 is a hole)
+void vdi::appendRun(std::vector<extent> &runs, uint32_t logical, uint32_t physical, uint32_t length) {
+  if (!runs.empty()) {
+    extent &last = runs.back();
+
+    // the new blocks continue the last run both logically and physically (or both are holes)
+    if (last.logical + last.length == logical &&
+        ((last.physical == 0 && physical == 0) || (last.physical != 0 && last.physical + last.length == physical))) {
+      last.length += length;
+      return;
+    }
+  }
+
+  runs.push_back({logical, physical, length});
+}
+
+// resolve the indirect block 'blockNum' of depth 'depth' (1 = SIB, 2 = DIB, 3 = TIB) into the run list
+// ('logical' is the first file block it covers and is moved past it, 'remaining' is the number of file blocks left)
+void vdi::mapIndirect(std::vector<extent> &runs, uint32_t blockNum, int depth, uint32_t &logical,
+                      uint32_t &remaining) {
+  // array length of the indirect block
+  uint32_t k = superblock.blockSize / 4;
+
+  // number of file blocks a single array entry covers at this depth (64-bit, a whole TIB of 64K blocks covers 2^42)
+  uint64_t span = 1;
+  for (int i = 1; i < depth; ++i) {
+    span *= k;
+  }
+
+  // a missing indirect block is a hole over everything it would have covered
+  if (blockNum == 0) {
+    uint32_t length = std::min<uint64_t>(remaining, span * k);
+    appendRun(runs, logical, 0, length);
+    logical += length;
+    remaining -= length;
+    return;
+  }
+
+  // get the whole decoded indirect block at once
+  std::shared_ptr<const std::vector<uint32_t>> entries = fetchIndirect(blockNum);
+
+  // number of lower indirect blocks read ahead in one batch (half the cache, so none are evicted before they are used)
+  uint32_t batch = engine != nullptr && depth > 1 ? std::max((size_t)1, indirectCache.capacity() / 2) : 0;
+
+  // loop through the array until the end of the file is reached
+  for (uint32_t i = 0; i < k && remaining > 0; ++i) {
+    uint32_t entry = (*entries)[i];
+
+    // read the next lower indirect blocks the file still needs all at once
+    if (batch != 0 && i % batch == 0) {
+      uint32_t needed = (remaining + span - 1) / span;
+      prefetchIndirect(entries->data() + i, std::min({batch, needed, k - i}));
+    }
+
+    if (depth == 1) {
+      // entry is a data block
+      appendRun(runs, logical++, entry, 1);
+      --remaining;
+    } else {
+      // entry is another indirect block one level down
+      mapIndirect(runs, entry, depth - 1, logical, remaining);
+    }
+  }
+}
+
+// resolve the extent tree node 'node' and everything below it into the run list (gaps between extents become holes)
+// ('logical' is the next file block to be mapped and is moved past the node, 'remaining' is the number of file blocks
+// left)
+void vdi::mapExtents(std::vector<extent> &runs, const extentNode &node, uint32_t &logical, uint32_t &remaining) {
+  // number of child nodes read ahead in one batch (half the cache, so none are evicted before they are used)
+  size_t batch = engine != nullptr && node.depth > 0 ? std::max((size_t)1, extentCache.capacity() / 2) : 0;
+
+  for (size_t i = 0; i < node.entries.size() && remaining > 0; ++i) {
+    const extent &entry = node.entries[i];
+
+    if (node.depth > 0) {
+      // read the next child nodes the file still needs all at once
+      if (batch != 0 && i % batch == 0) {
+        size_t needed = i;
+        while (needed < node.entries.size() && needed < i + batch &&
+               node.entries[needed].logical < (uint64_t)logical + remaining) {
+          ++needed;
+        }
+        prefetchExtentNodes(node.entries.data() + i, needed - i);
+      }
+
+      // entry is another node one level down
+      mapExtents(runs, *fetchExtentNode(entry.physical, node.depth - 1), logical, remaining);
+      continue;
+    }
+
+    // skip extents (or the parts of them) that were already mapped
+    if ((uint64_t)entry.logical + entry.length <= logical) {
+      continue;
+    }
+
+    // the file blocks before the extent are a hole
+    if (entry.logical > logical) {
+      uint32_t gap = std::min(entry.logical - logical, remaining);
+      appendRun(runs, logical, 0, gap);
+      logical += gap;
+      remaining -= gap;
+      if (remaining == 0) {
+        break;
+      }
+    }
+
+    // the extent itself, cut off at the end of the file
+    uint32_t skip = logical - entry.logical;
+    uint32_t length = std::min(entry.length - skip, remaining);
+    appendRun(runs, logical, entry.physical != 0 ? entry.physical + skip : 0, length);
+    logical += length;
+    remaining -= length;
+  }
+}
+
+// resolve the block tree of the file represented by the supplied inode into a list of contiguous runs
+// (in logical order, only covering the blocks within the file's size)
+std::vector<vdi::extent> vdi::mapFile(const vdi::inode &in) {
+  std::vector<extent> runs;
+
+  // number of blocks the file takes up
+  uint32_t remaining = (in.size + superblock.blockSize - 1) / superblock.blockSize;
+
+  // the next file block to be mapped
+  uint32_t logical = 0;
+
+  // ext4 extent tree, the runs come straight out of its leaves (anything they do not cover is a hole)
+  if (in.flags & extentsFlag) {
+    mapExtents(runs, *rootExtentNode(in), logical, remaining);
+    if (remaining > 0) {
+      appendRun(runs, logical, 0, remaining);
+    }
+    return runs;
+  }
+
+  // direct blocks stored in the inode block array
+  for (uint32_t i = 0; i < 12 && remaining > 0; ++i, --remaining) {
+    appendRun(runs, logical++, in.block[i], 1);
+  }
+
+  // single, double and triple indirect blocks
+  for (int depth = 1; depth <= 3 && remaining > 0; ++depth) {
+    mapIndirect(runs, in.block[11 + depth], depth, logical, remaining);
+  }
+
+  return runs;
+}
+
+// copy the whole file represented by the supplied inode to 'hostPath' on the host system
+// (each physically contiguous run is copied by the kernel where possible, otherwise with a single large read)
+void vdi::extractFile(const vdi::inode &in, const char *hostPath) {
+  // resolve the block tree into runs and copy those
+  std::vector<extent> runs = mapFile(in);
+  extractRuns(runs.data(), runs.size(), in.size, hostPath);
+}
+
+// copy a file of 'size' bytes made up of the 'count' runs starting at 'runs' to 'hostPath' on the host system
+// (the runs must come from 'mapFile', or from a path index built with it)
+void vdi::extractRuns(const vdi::extent *runs, size_t count, uint64_t size, const char *hostPath) {
+#ifdef _WIN32
+  // open the file to write out to (holes are written out as zeros)
+  std::ofstream out;
+  out.open(hostPath, std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("cannot open output file: " + std::string(hostPath));
+  }
+#else
+  // open the file to write out to (a descriptor, so the kernel can copy into it directly)
+  int out = open(hostPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    throw std::runtime_error("cannot open output file: " + std::string(hostPath));
+  }
+#endif
+
+#ifdef _WIN32
+  // largest number of bytes read at once (longer runs are read in pieces of this size)
+  const uint32_t maxChunk = 16 << 20;
+#endif
+
+  // buffer for holding each piece of a run (only used when the data has to pass through user space)
+  std::vector<char> buffer;
+
+  // number of file bytes left to write (the last block is only partially used)
+  uint64_t remaining = size;
+
+  // the pipeline is chosen once per file: with ring buffers set up the whole file goes through them at once,
+  // otherwise the runs are copied one by one below
+#ifdef _WIN32
+  const bool piped = false;
+#else
+  const bool piped = pipelineBufferCount != 0;
+#endif
+
+  try {
+#ifndef _WIN32
+    if (piped) {
+      pipeRuns(out, hostPath, runs, count, size);
+    }
+#endif
+
+    for (size_t i = 0; i < count && !piped; ++i) {
+      const extent &run = runs[i];
+
+      // bytes of the file inside this run
+      uint64_t runBytes = std::min((uint64_t)run.length * superblock.blockSize, remaining);
+
+#ifdef _WIN32
+      for (uint64_t done = 0; done < runBytes;) {
+        uint32_t chunk = std::min((uint64_t)maxChunk, runBytes - done);
+        buffer.resize(std::max((size_t)chunk, buffer.size()));
+
+        if (run.physical == 0) {
+          // holes read back as zeros
+          memset(buffer.data(), 0, chunk);
+        } else {
+          // read the piece of the run in one go
+          readAt(buffer.data(), locateBlock(run.physical - superblock.firstDataBlock) + done, chunk);
+        }
+
+        out.write(buffer.data(), chunk);
+        done += chunk;
+      }
+#else
+      if (run.physical == 0) {
+        // holes are skipped over and left unallocated in the output file (its size is set at the end)
+        if (lseek(out, runBytes, SEEK_CUR) < 0) {
+          throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+        }
+      } else {
+        // data runs are copied from the VDI file to the output file without passing through this process if possible
+        copyRun(out, hostPath, locateBlock(run.physical - superblock.firstDataBlock), runBytes, buffer);
+      }
+#endif
+
+      remaining -= runBytes;
+    }
+  } catch (...) {
+#ifndef _WIN32
+    close(out);
+#endif
+    throw;
+  }
+
+#ifdef _WIN32
+  if (!out) {
+    throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+  }
+#else
+  // a file ending in a hole is only as long as its last data run so far
+  if (ftruncate(out, size) != 0) {
+    close(out);
+    throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+  }
+
+  if (close(out) != 0) {
+    throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+  }
+#endif
+}
+
+// make 'extractRuns' copy through a ring of 'bufferCount' aligned buffers of 'bufferSize' bytes each, filled by the
+// calling thread and written out by a second thread at the same time (0 buffers goes back to the kernel side copy)
+// note: worth it when the VDI file and the output are on different devices (POSIX only, ignored on Windows)
+void vdi::setExtractPipeline(uint32_t bufferCount, uint32_t bufferSize) {
+  if (bufferCount != 0 && bufferSize == 0) {
+    throw std::invalid_argument("cannot set up the extraction pipeline, the buffer size cannot be zero");
+  }
+
+  pipelineBufferCount = bufferCount;
+  pipelineBufferSize = bufferSize;
+}
+
+#ifndef _WIN32
+// copy the 'size' bytes of the virtual disk starting at byte 'position' to the current offset of the descriptor 'out'
+// ('hostPath' is the file 'out' was opened from, only used in error messages)
+// note: unallocated pieces of the image are skipped over as holes (the caller sets the final file size)
+void vdi::copyRun(int out, const char *hostPath, uint64_t position, uint64_t size, std::vector<char> &buffer) {
+  for (uint64_t done = 0; done < size;) {
+    // the next piece that is stored contiguously in the VDI file (offset position to the start of the partition)
+    uint32_t piece = std::min(size - done, (uint64_t)1 << 30);
+    uint64_t filePosition;
+
+    if (image->locate(partitionStart + position + done, piece, filePosition)) {
+      copyFileRange(out, hostPath, filePosition, piece, buffer);
+    } else if (lseek(out, piece, SEEK_CUR) < 0) {
+      throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+    }
+
+    done += piece;
+  }
+}
+
+// copy the 'size' bytes of the VDI file starting at byte 'position' to the current offset of the descriptor 'out'
+// ('hostPath' is the file 'out' was opened from, only used in error messages)
+// note: tries 'copy_file_range' (kernel side copy, reflinks where supported) then 'sendfile', and only reads the data
+// through 'buffer' when neither works between the two files
+void vdi::copyFileRange(int out, const char *hostPath, uint64_t position, uint32_t size, std::vector<char> &buffer) {
+  uint32_t done = 0;
+
+#ifdef __linux__
+  // the kernel copies straight from the VDI file (filesystems with reflinks can share the blocks instead)
+  while (done < size) {
+    loff_t from = position + done;
+    ssize_t moved = copy_file_range(source->descriptor(), &from, out, NULL, size - done, 0);
+    if (moved <= 0) {
+      break;
+    }
+    done += moved;
+  }
+
+  // not supported between these two files (older kernels, some filesystem pairs), let the kernel copy it page by page
+  while (done < size) {
+    off_t from = position + done;
+    ssize_t moved = sendfile(out, source->descriptor(), &from, size - done);
+    if (moved <= 0) {
+      break;
+    }
+    done += moved;
+  }
+#endif
+
+  // copy whatever is left through user space
+  const uint32_t maxChunk = 16 << 20;
+  while (done < size) {
+    uint32_t chunk = std::min(maxChunk, size - done);
+    buffer.resize(std::max((size_t)chunk, buffer.size()));
+
+    source->read(buffer.data(), position + done, chunk);
+    writeAll(out, buffer.data(), chunk, -1, hostPath);
+    done += chunk;
+  }
+}
+
+// write all 'size' bytes of 'buffer' to the descriptor 'out' at byte 'position' (or at its current offset when
+// 'position' is -1, 'hostPath' is only used in the error message)
+void vdi::writeAll(int out, const char *buffer, size_t size, int64_t position, const char *hostPath) {
+  // 'write' may write less than requested, keep writing until everything is out
+  while (size > 0) {
+    ssize_t count = position < 0 ? write(out, buffer, size) : pwrite(out, buffer, size, position);
+    if (count <= 0) {
+      throw std::runtime_error("cannot write output file: " + std::string(hostPath));
+    }
+    buffer += count;
+    size -= count;
+    if (position >= 0) {
+      position += count;
+    }
+  }
+}
+
+// copy the data runs of a file of 'size' bytes made up of the 'count' runs starting at 'runs' to the descriptor 'out'
+// through the ring buffers set with 'setExtractPipeline' (holes are left unwritten)
+void vdi::pipeRuns(int out, const char *hostPath, const vdi::extent *runs, size_t count, uint64_t size) {
+  // structure of a ring slot: its buffer and the piece of the file it holds once filled
+  struct slot {
+    std::unique_ptr<char, void (*)(void *)> data{NULL, free};
+    uint64_t position;
+    uint32_t length;
+  };
+
+  // the ring (page aligned, so the buffers also suit direct I/O)
+  std::vector<slot> ring(pipelineBufferCount);
+  for (slot &s : ring) {
+    void *data;
+    if (posix_memalign(&data, 4096, pipelineBufferSize) != 0) {
+      throw std::bad_alloc();
+    }
+    s.data.reset(static_cast<char *>(data));
+  }
+
+  // number of slots filled by the reader and drained by the writer so far (slot n is ring[n % ring.size()])
+  uint64_t filled = 0, drained = 0;
+
+  // set when the reader is done, or the writer failed
+  bool finished = false;
+  std::exception_ptr writeError;
+
+  // guards the four variables above
+  std::mutex lock;
+  std::condition_variable changed;
+
+  // the writer drains the filled slots in order
+  std::thread writer([&] {
+    try {
+      while (true) {
+        const slot *next;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          changed.wait(guard, [&] { return drained < filled || finished; });
+          if (drained == filled) {
+            return;
+          }
+          next = &ring[drained % ring.size()];
+        }
+
+        writeAll(out, next->data.get(), next->length, next->position, hostPath);
+
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          ++drained;
+        }
+        changed.notify_all();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(lock);
+      writeError = std::current_exception();
+      changed.notify_all();
+    }
+  });
+
+  // the calling thread fills the free slots in file order
+  std::exception_ptr readError;
+  try {
+    uint64_t position = 0, remaining = size;
+
+    for (size_t i = 0; i < count && remaining > 0; ++i) {
+      const extent &run = runs[i];
+      uint64_t runBytes = std::min((uint64_t)run.length * superblock.blockSize, remaining);
+
+      for (uint64_t done = 0; run.physical != 0 && done < runBytes;) {
+        // wait for a free slot (or stop when the writer failed)
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          changed.wait(guard, [&] { return filled - drained < ring.size() || writeError; });
+          if (writeError) {
+            break;
+          }
+        }
+
+        // fill it with the next piece of the run
+        slot &next = ring[filled % ring.size()];
+        next.length = std::min((uint64_t)pipelineBufferSize, runBytes - done);
+        next.position = position + done;
+        readAt(next.data.get(), locateBlock(run.physical - superblock.firstDataBlock) + done, next.length);
+        done += next.length;
+
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          ++filled;
+        }
+        changed.notify_all();
+      }
+
+      position += runBytes;
+      remaining -= runBytes;
+    }
+  } catch (...) {
+    readError = std::current_exception();
+  }
+
+  // let the writer drain what is left and finish
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    finished = true;
+  }
+  changed.notify_all();
+  writer.join();
+
+  if (readError) {
+    std::rethrow_exception(readError);
+  }
+  if (writeError) {
+    std::rethrow_exception(writeError);
+  }
+}
+#endif
+
+// open the directory with the given inode number and return a pointer to the directory struct
+vdi::directory *vdi::openDir(uint32_t iNum) {
+  // create new directory pointer
+  auto *d = new directory;
+
+  // fill out directory struct fields
+  fetchInode(d->in, iNum);
+  d->iNum = iNum;
+  d->block = new char[superblock.blockSize];
+
+  // return directory pointer
+  return d;
+}
+
+// fetch the next directory entry inside the given directory
+// fill the inode number and name of the entry into 'iNum' and 'name'
 // returns true on success, false if it hit the end of the directory
 bool vdi::getNextDirEntry(vdi::directory *d, uint32_t &iNum, char *name) {
   // only run if there is another entry in the given directory
@@ -1422,31 +2520,298 @@ void vdi::closeDir(vdi::directory *d) {
   delete d;
 }
 
+// start iterating the directory with inode number 'iNum'
+// ('buffer' must be at least size 'superblock.blockSize', it is unused with the mmap backend)
+void vdi::openDirStream(vdi::dirStream &ds, uint32_t iNum, char *buffer) {
+  fetchInode(ds.in, iNum);
+  ds.iNum = iNum;
+  ds.cursor = 0;
+  ds.buffer = buffer;
+  ds.block = NULL;
+  ds.loadedBlock = 0;
+}
+
+// get the next entry of the directory as a view into its block (each block is loaded only once)
+// note: unused entries (inode 0) are skipped, the view is only valid until the next call
+// returns true on success, false if it hit the end of the directory
+bool vdi::nextDirEntry(vdi::dirStream &ds, vdi::dirEntryView &entry) {
+  while (ds.cursor < ds.in.size) {
+    // calculate block number and the offset within the block
+    uint32_t blockNum = ds.cursor / superblock.blockSize;
+    uint32_t offset = ds.cursor % superblock.blockSize;
+
+    // load the block the cursor is in, unless it is already loaded
+    if (ds.block == NULL || ds.loadedBlock != blockNum) {
+      // a hole holds no entries, skip to the start of the next block
+      uint32_t diskBlock = locateFileBlock(ds.in, blockNum);
+      if (diskBlock == 0) {
+        ds.cursor += superblock.blockSize - offset;
+        continue;
+      }
+
+      ds.block = view(ds.buffer, locateBlock(diskBlock - superblock.firstDataBlock), superblock.blockSize);
+      ds.loadedBlock = blockNum;
+    }
+
+    // the raw entry at the cursor
+    const char *raw = ds.block + offset;
+    uint32_t recLen = decodeRecLen(raw);
+
+    // an entry can never be smaller than its 8 byte header and name or cross the end of its block
+    if (recLen < 8 || (uint8_t)raw[6] + 8 > recLen || offset + recLen > superblock.blockSize) {
+      throw std::runtime_error("cannot read directory, entry at byte " + std::to_string(ds.cursor) + " of inode " +
+                               std::to_string(ds.iNum) + " is corrupt");
+    }
+
+    // increment cursor to the start of the next entry
+    ds.cursor += recLen;
+
+    // fill out the entry view
+    entry.iNum = littleEndianToInt(raw, 4);
+    entry.nameLen = littleEndianToInt(raw + 6, 1);
+    entry.fileType = littleEndianToInt(raw + 7, 1);
+    entry.name = raw + 8;
+
+    // skip unused entries
+    if (entry.iNum != 0) {
+      return true;
+    }
+  }
+
+  // hit the end of the directory
+  return false;
+}
+
 // searches a directory with inode 'iNum' for the target file 'target' and returns the inode number of the file
 // note: returns 0 if a file is not found
 uint32_t vdi::searchDir(uint32_t iNum, char *target) {
+  // length of the target name (compared first so most entries are rejected without touching the name)
+  size_t targetLen = strlen(target);
+
+  // looked up before (a cached 0 means the file is known to not exist)
+  uint32_t found;
+  if (dentryCache.get(dentryKey(iNum, target, targetLen), found)) {
+    return found;
+  }
+
+  // block buffer for the directory stream (on the stack, nothing to allocate or free)
+  char buffer[maxBlockSize];
+
   // open the directory at inode number 'iNum'
-  directory *d = openDir(iNum);
+  dirStream ds;
+  openDirStream(ds, iNum, buffer);
 
-  // variable for holding the name of the file found in each directory entry
-  char currentEntryName[256];
+  // buffers for the blocks on the way down an HTree index (allocated once per thread, too large for the stack)
+  static thread_local std::vector<char> levelBuffers((size_t)maxHTreeLevels * maxBlockSize);
+
+  // directories with an on-disk HTree index only need the blocks on the way down to the name's leaf block
+  if (searchHTree(ds, target, targetLen, found, levelBuffers.data())) {
+    dentryCache.put(dentryKey(iNum, target, targetLen), found);
+    return found;
+  }
+
+  // other large directories are searched through a hash index built on their first lookup
+  uint32_t threshold = dirIndexThreshold.load(std::memory_order_relaxed);
+  if (threshold != 0 && ds.in.size / superblock.blockSize >= threshold) {
+    std::shared_ptr<const std::unordered_map<std::string, uint32_t>> index = fetchDirIndex(ds);
+
+    auto entry = index->find(std::string(target, targetLen));
+    found = entry == index->end() ? 0 : entry->second;
+    dentryCache.put(dentryKey(iNum, target, targetLen), found);
+
+    return found;
+  }
 
   // loop through the directory entries to find the file
-  while (getNextDirEntry(d, iNum, currentEntryName)) {
+  found = 0;
+  dirEntryView entry{};
+  while (nextDirEntry(ds, entry)) {
     // compare the current entry with the target string
-    if (strcmp(target, currentEntryName) == 0) {
+    if (entry.nameLen == targetLen && memcmp(target, entry.name, targetLen) == 0) {
       // file found
+      found = entry.iNum;
+      break;
+    }
+  }
 
-      // close the directory, return the inode number
-      closeDir(d);
-      return iNum;
+  // remember the result (a miss too), the entries passed on the way are not cached so a scan of a large directory
+  // does not push every other lookup out of the cache
+  dentryCache.put(dentryKey(iNum, target, targetLen), found);
+
+  return found;
+}
+
+// look up the name 'target' (of length 'targetLen') through the HTree index of the directory opened in 'ds'
+// (hashes the name and follows the dx_root and dx_node blocks down to the one leaf block that can hold it)
+// returns true on success with the inode number in 'found' (0 = not in the directory), false if the directory has no
+// usable index and has to be searched linearly
+// ('buffers' must be at least size 'maxHTreeLevels * maxBlockSize', it is unused with the mmap backend)
+bool vdi::searchHTree(vdi::dirStream &ds, const char *target, size_t targetLen, uint32_t &found, char *buffers) {
+  // only indexed directories on filesystems with the feature (encrypted and case-insensitive names hash differently)
+  if (!(superblock.featureCompat & compatDirIndex) || !(ds.in.flags & indexFlag) ||
+      (ds.in.flags & (encryptFlag | casefoldFlag))) {
+    return false;
+  }
+
+  // number of blocks in the directory
+  uint32_t dirBlocks = ds.in.size / superblock.blockSize;
+
+  // get block 'bNum' of the directory into the buffer of level 'level' (NULL if it is a hole or outside the directory)
+  // note: every level has a buffer of its own, the index blocks above the current one stay needed for hash collisions
+  auto loadBlock = [&](uint32_t bNum, uint32_t level) -> const char * {
+    uint32_t diskBlock = bNum < dirBlocks ? locateFileBlock(ds.in, bNum) : 0;
+    if (diskBlock == 0) {
+      return NULL;
     }
+    return view(buffers + (size_t)level * superblock.blockSize,
+                locateBlock(diskBlock - superblock.firstDataBlock), superblock.blockSize);
+  };
+
+  // the dx_root sits in block 0 behind the '.' and '..' entries (12 bytes each), followed by its info and entries
+  const char *root = loadBlock(0, 0);
+  if (root == NULL) {
+    return false;
+  }
+  uint8_t hashVersion = root[28], infoLength = root[29], levels = root[30];
+  if (littleEndianToInt(root + 24, 4) != 0 || infoLength != 8 ||
+      levels >= ((superblock.featureIncompat & incompatLargeDir) ? 3 : 2) || !dirHash::supported(hashVersion)) {
+    return false;
   }
 
-  // file not found
-  return 0;
+  // the signed hashes become their unsigned variants on filesystems that say so
+  if (hashVersion <= dirHash::tea && (superblock.flags & unsignedHashFlag)) {
+    hashVersion += dirHash::legacyUnsigned;
+  }
+  uint32_t hash = dirHash::hash(target, targetLen, hashVersion, superblock.hashSeed);
+
+  // the index entries of each level on the way down and the one followed (entry 0 holds the limit and count in place
+  // of a hash and covers every hash below that of entry 1, every entry is a hash and a directory block number)
+  const char *entries[maxHTreeLevels];
+  uint32_t counts[maxHTreeLevels], positions[maxHTreeLevels];
+
+  // read the entries of an index block of level 'level' starting at 'start' and pick the last one with a hash at or
+  // below the name's (returns false if the counts do not fit the block)
+  auto probe = [&](const char *block, const char *start, uint32_t level) {
+    uint16_t limit = littleEndianToInt(start, 2), count = littleEndianToInt(start + 2, 2);
+    if (count == 0 || count > limit || start + (size_t)count * 8 > block + superblock.blockSize) {
+      return false;
+    }
+
+    uint32_t low = 1, high = count;
+    while (low < high) {
+      uint32_t middle = (low + high) / 2;
+      if (littleEndianToInt(start + middle * 8, 4) > hash) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+
+    entries[level] = start;
+    counts[level] = count;
+    positions[level] = low - 1;
+    return true;
+  };
+
+  // get the directory block the followed entry of level 'level' points to (the top 4 bits are not part of it)
+  auto childBlock = [&](uint32_t level) {
+    return (uint32_t)littleEndianToInt(entries[level] + positions[level] * 8 + 4, 4) & 0x0fffffff;
+  };
+
+  // walk from level 'level' down to the leaf level, loading the dx_node blocks below it
+  auto descend = [&](uint32_t level) {
+    for (; level < levels; ++level) {
+      // a dx_node starts with an empty entry covering the whole block
+      const char *node = loadBlock(childBlock(level), level + 1);
+      if (node == NULL || littleEndianToInt(node, 4) != 0 || decodeRecLen(node) != superblock.blockSize ||
+          !probe(node, node + 8, level + 1)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  if (!probe(root, root + 24 + infoLength, 0) || !descend(0)) {
+    return false;
+  }
+
+  while (true) {
+    // search the leaf block like any other directory block
+    const char *leaf = loadBlock(childBlock(levels), levels + 1);
+    if (leaf == NULL) {
+      return false;
+    }
+
+    for (uint32_t offset = 0; offset + 8 <= superblock.blockSize;) {
+      const char *raw = leaf + offset;
+      uint32_t recLen = decodeRecLen(raw);
+      if (recLen < 8 || (uint8_t)raw[6] + 8 > recLen || offset + recLen > superblock.blockSize) {
+        return false;
+      }
+
+      uint32_t entryInode = littleEndianToInt(raw, 4);
+      if (entryInode != 0 && (uint8_t)raw[6] == targetLen && memcmp(raw + 8, target, targetLen) == 0) {
+        found = entryInode;
+        return true;
+      }
+
+      offset += recLen;
+    }
+
+    // names with the same hash can continue in the next leaf block, move to the next entry (going up a level when a
+    // block runs out of entries) and keep going only if its hash is the name's hash
+    int level = levels;
+    while (level >= 0 && ++positions[level] >= counts[level]) {
+      --level;
+    }
+    if (level < 0 || (littleEndianToInt(entries[level] + positions[level] * 8, 4) & ~1u) != hash) {
+      found = 0;
+      return true;
+    }
+    if (!descend(level)) {
+      return false;
+    }
+  }
+}
+
+// get the hash index (name -> inode number) of the directory opened in 'ds', building it on the first call
+// note: 'ds' must not have been iterated yet
+std::shared_ptr<const std::unordered_map<std::string, uint32_t>> vdi::fetchDirIndex(vdi::dirStream &ds) {
+  std::shared_ptr<const std::unordered_map<std::string, uint32_t>> index;
+
+  // built by an earlier lookup
+  if (dirIndexCache.get(ds.iNum, index)) {
+    return index;
+  }
+
+  // read the whole directory once and hash every entry
+  auto built = std::make_shared<std::unordered_map<std::string, uint32_t>>();
+  dirEntryView entry{};
+  while (nextDirEntry(ds, entry)) {
+    built->emplace(std::string(entry.name, entry.nameLen), entry.iNum);
+  }
+
+  dirIndexCache.put(ds.iNum, built);
+
+  return built;
 }
 
+// build the dentry cache key of the entry named 'name' (of length 'nameLen') inside the directory with inode 'parent'
+std::string vdi::dentryKey(uint32_t parent, const char *name, size_t nameLen) {
+  std::string key(reinterpret_cast<const char *>(&parent), sizeof(parent));
+  key.append(name, nameLen);
+  return key;
+}
+
+// set how many directory entry lookups the dentry cache holds at once (0 disables the cache, default is 16384)
+void vdi::setDentryCacheCapacity(size_t capacity) { dentryCache.setCapacity(capacity); }
+
+// get the hit and miss counts of the dentry cache
+vdi::cacheStats vdi::dentryCacheStats() const { return {dentryCache.hits(), dentryCache.misses()}; }
+
+// set the directory size (in blocks) from which 'searchDir' builds and uses a hash index (0 disables indexing)
+void vdi::setDirIndexThreshold(uint32_t blocks) { dirIndexThreshold.store(blocks, std::memory_order_relaxed); }
+
 // takes a full file path and returns the inode number of the file
 uint32_t vdi::traversePath(char *path) {
   // used in the following while-loop as an index for 'path' array
@@ -1489,10 +2854,28 @@ uint32_t vdi::traversePath(char *path) {
 
 // print the info of a file at the current 'directory entry' stored in directory 'd'
 void vdi::printFileInfo(vdi::directory *d) {
+  // forward the current entry as an entry view
+  printFileInfo({d->entry.iNum, d->entry.fileType, d->entry.nameLen, d->entry.name});
+}
+
+// print the info of the file the directory entry view 'entry' points to
+void vdi::printFileInfo(const vdi::dirEntryView &entry) {
+  std::string line;
+  formatFileInfo(entry, line);
+  std::cout << line;
+}
+
+// append the line 'printFileInfo' prints for the directory entry view 'entry' to 'out'
+void vdi::formatFileInfo(const vdi::dirEntryView &entry, std::string &out) {
   // get directory entry inode
   inode i{};
-  fetchInode(i, d->entry.iNum);
+  fetchInode(i, entry.iNum);
 
+  formatFileInfo(entry, i, out);
+}
+
+// same as above, but with the entry's inode 'i' already read
+void vdi::formatFileInfo(const vdi::dirEntryView &entry, const vdi::inode &i, std::string &out) {
   // get mtime as a time object
   time_t mtime = i.mtime;
 
@@ -1500,7 +2883,7 @@ void vdi::printFileInfo(vdi::directory *d) {
   std::string permissions;
 
   // if the entry is a folder
-  if (d->entry.fileType == 2) {
+  if (entry.fileType == 2) {
     // mark as 'd'
     permissions += "d";
   } else {
@@ -1609,13 +2992,89 @@ void vdi::printFileInfo(vdi::directory *d) {
       throw std::invalid_argument("cannot interpret file permission for 'other', value not between 0-7 (octal)");
   }
 
-  // trim the newline off the end of the mtime
-  std::string mtime_string = ctime(&mtime);
+  // trim the newline off the end of the mtime ('ctime' shares one buffer between all threads, so it is not used)
+  // (a time the C library cannot convert, e.g. a year past 9999 on some systems, is shown as a placeholder)
+  char mtime_buffer[64];
+#ifdef _WIN32
+  bool converted = ctime_s(mtime_buffer, sizeof(mtime_buffer), &mtime) == 0;
+#else
+  bool converted = ctime_r(&mtime, mtime_buffer) != NULL;
+#endif
+  std::string mtime_string = converted ? mtime_buffer : "?\n";
   mtime_string[mtime_string.length() - 1] = '\0';
 
-  // print file/folder info
-  std::cout << permissions << ' ' << i.linksCount << '\t' << i.uid << '\t' << i.gid << '\t' << i.size << "      \t"
-            << mtime_string << '\t' << d->entry.name << '\n';
+  // format file/folder info
+  std::ostringstream line;
+  line << permissions << ' ' << i.linksCount << '\t' << i.uid << '\t' << i.gid << '\t' << i.size << "      \t"
+       << mtime_string << '\t';
+  line.write(entry.name, entry.nameLen) << '\n';
+  out += line.str();
+}
+
+// calls the callbacks of 'visitor' for every entry below the directory at inode 'iNum' (except . and ..), depth first
+// note: no recursion, the walk keeps 8 bytes per directory level and a single block buffer however deep the tree is
+// (a directory is re-read from its inode when the walk comes back up to it, usually from the caches)
+void vdi::visitTree(uint32_t iNum, const vdi::treeVisitor &visitor) {
+  // structure of a directory the walk went down from (its inode number and the offset of the entry it went into)
+  struct walkFrame {
+    uint32_t iNum, entryCursor;
+  };
+
+  // the directories above the current one, reused for the whole walk
+  std::vector<walkFrame> stack;
+
+  // the one block buffer and directory stream shared by every level
+  std::vector<char> buffer(superblock.blockSize);
+  dirStream ds;
+  openDirStream(ds, iNum, buffer.data());
+
+  dirEntryView entry{};
+  while (true) {
+    // hit the end of the current directory
+    if (!nextDirEntry(ds, entry)) {
+      if (stack.empty()) {
+        break;
+      }
+
+      // go back up: reopen the parent at the entry of the directory that just finished
+      walkFrame parent = stack.back();
+      stack.pop_back();
+      openDirStream(ds, parent.iNum, buffer.data());
+      ds.cursor = parent.entryCursor;
+      nextDirEntry(ds, entry);
+
+      if (visitor.postDir) {
+        visitor.postDir(entry, stack.size());
+      }
+      continue;
+    }
+
+    // skip the . and .. entries
+    if ((entry.nameLen == 1 && entry.name[0] == '.') ||
+        (entry.nameLen == 2 && entry.name[0] == '.' && entry.name[1] == '.')) {
+      continue;
+    }
+
+    // other entries only need their callback
+    if (entry.fileType != 2) {
+      if (visitor.file) {
+        visitor.file(entry, stack.size());
+      }
+      continue;
+    }
+
+    // the entry is a folder, ask whether to go into it
+    if (visitor.preDir && !visitor.preDir(entry, stack.size())) {
+      continue;
+    }
+
+    // remember where the entry is (the view points into the current block, 8 bytes past the start of the entry)
+    uint32_t entryCursor = ds.loadedBlock * superblock.blockSize + (uint32_t)(entry.name - 8 - ds.block);
+    stack.push_back({ds.iNum, entryCursor});
+
+    // go down into the folder
+    openDirStream(ds, entry.iNum, buffer.data());
+  }
 }
 
 // prints all files and directories inside the VDI file starting at inode 'iNum' and goes to the end of the disk
@@ -1623,27 +3082,114 @@ void vdi::printFileInfo(vdi::directory *d) {
 void vdi::printAllFiles(uint32_t iNum) {
   // TODO: print the file's full path and not just the file name
 
+  treeVisitor visitor;
+  visitor.preDir = [this](const dirEntryView &dir, uint32_t) {
+    printFileInfo(dir);
+    return true;
+  };
+  visitor.file = [this](const dirEntryView &file, uint32_t) { printFileInfo(file); };
+
+  visitTree(iNum, visitor);
+}
+
+// same as above, but the inodes come from 'inodes' (filled by 'scanInodes') instead of one lookup per entry
+void vdi::printAllFiles(uint32_t iNum, const vdi::inodeSet &inodes) {
+  // print an entry with its inode from the set (an entry pointing at an unused inode prints as an empty inode)
+  auto print = [this, &inodes](const dirEntryView &entry) {
+    static const inode unused{};
+    uint32_t slot = entry.iNum < inodes.slot.size() ? inodes.slot[entry.iNum] : 0;
+
+    std::string line;
+    formatFileInfo(entry, slot != 0 ? inodes.inodes[slot - 1] : unused, line);
+    std::cout << line;
+  };
+
+  treeVisitor visitor;
+  visitor.preDir = [&print](const dirEntryView &dir, uint32_t) {
+    print(dir);
+    return true;
+  };
+  visitor.file = [&print](const dirEntryView &file, uint32_t) { print(file); };
+
+  visitTree(iNum, visitor);
+}
+
+// same as above, but the directories are read by 'threadCount' worker threads (0 = one per hardware thread)
+// note: the output is exactly the same as the single threaded version
+void vdi::printAllFiles(uint32_t iNum, unsigned threadCount) {
+  // a single worker would only add the cost of buffering the output
+  if (threadCount == 1) {
+    printAllFiles(iNum);
+    return;
+  }
+
+  threadPool pool(threadCount);
+  walkTree(iNum, pool, [this](const dirEntryView &entry, std::string &out) { formatFileInfo(entry, out); },
+           std::cout);
+}
+
+// calls 'visit' for every entry below the directory at inode 'iNum' (except . and ..) and writes everything the
+// calls append to their string to 'out', in the same depth first order as a single threaded walk
+// (each directory is read by its own task on 'pool', so 'visit' is called from many threads at once)
+void vdi::walkTree(uint32_t iNum, threadPool &pool,
+                   const std::function<void(const dirEntryView &, std::string &)> &visit, std::ostream &out) {
+  // read every directory, the subdirectories are queued by the tasks themselves
+  walkSegment root;
+  pool.submit([this, iNum, &root, &pool, &visit] { walkDir(iNum, &root, pool, visit); });
+  pool.wait();
+
+  // write the pieces out depth first (with an explicit stack, trees can be deeper than the call stack allows)
+  std::vector<std::pair<const walkSegment *, size_t>> stack{{&root, 0}};
+  while (!stack.empty()) {
+    const walkSegment *segment = stack.back().first;
+    size_t part = stack.back().second++;
+
+    if (part == segment->parts.size()) {
+      stack.pop_back();
+      continue;
+    }
+
+    out << segment->parts[part].first;
+    if (segment->parts[part].second != nullptr) {
+      stack.emplace_back(segment->parts[part].second.get(), 0);
+    }
+  }
+}
+
+// 'walkTree' task that reads the directory at inode 'iNum' into 'segment', queueing a task for every subdirectory
+void vdi::walkDir(uint32_t iNum, walkSegment *segment, threadPool &pool,
+                  const std::function<void(const dirEntryView &, std::string &)> &visit) {
+  // block buffer for this directory's stream
+  std::vector<char> buffer(superblock.blockSize);
+
   // open the directory at inode 'iNum'
-  directory *d = openDir(iNum);
+  dirStream ds;
+  openDirStream(ds, iNum, buffer.data());
 
-  // variable for holding file name of each entry
-  char name[256];
+  // output of the entries since the last subdirectory
+  std::string text;
 
-  // loop through the current directory
-  while (getNextDirEntry(d, iNum, name)) {
+  // loop through the directory
+  dirEntryView entry{};
+  while (nextDirEntry(ds, entry)) {
     // skip the . and .. entries
-    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+    if ((entry.nameLen == 1 && entry.name[0] == '.') ||
+        (entry.nameLen == 2 && entry.name[0] == '.' && entry.name[1] == '.')) {
+      continue;
+    }
+
+    visit(entry, text);
 
-    // print file/folder information
-    printFileInfo(d);
+    // if current entry is a folder, its output goes right after this entry's (it is read by another task)
+    if (entry.fileType == 2) {
+      walkSegment *child = new walkSegment;
+      segment->parts.emplace_back(std::move(text), std::unique_ptr<walkSegment>(child));
+      text.clear();
 
-    // if current entry is a folder
-    if (d->entry.fileType == 2) {
-      // recursive call to this function with the current folder
-      printAllFiles(iNum);
+      uint32_t childINum = entry.iNum;
+      pool.submit([this, childINum, child, &pool, &visit] { walkDir(childINum, child, pool, visit); });
     }
   }
 
-  // close the directory
-  closeDir(d);
+  segment->parts.emplace_back(std::move(text), nullptr);
 }
@@ -5,83 +5,220 @@
 #ifndef OS_TERM_PROJECT_VDI_H
 #define OS_TERM_PROJECT_VDI_H
 
+#include <atomic>
 #include <cstdint>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "container.h"
+#include "lruCache.h"
+#include "readEngine.h"
+
+class imageFile;
+class threadPool;
 
 class vdi {
  private:
   /* VARIABLES */
 
-  // the actual VDI file on the disk
+  // the actual VDI file on the disk (only used by the cursor API, every other read goes through 'source')
   std::fstream VDI_file;
 
-  // size of the VDI file (0 = file not opened)
-  uint32_t fileSize = 0;
+  // the opened image file (shared by every handle on a partition of the same image)
+  std::shared_ptr<imageFile> source;
+
+  // start of the filesystem's partition as a position in the image file (used by the cursor API, only meaningful for
+  // images that store the partition in order, see 'openedPartitionInOrder')
+  uint64_t diskStart = 0;
+
+  // number of the partition whose filesystem this handle reads (1 based, see 'partitionTable')
+  int filesystemPartition = 1;
 
-  // the starting location of the VDI's disk (0 = not yet set)
-  uint32_t diskStart = 0;
+  // byte offset of the filesystem's partition inside the virtual disk ('readAt' positions are relative to it)
+  uint64_t partitionStart = 0;
+
+  // the disk image container the file is read through (translates virtual disk positions into file positions, shared
+  // by every handle on a partition of the same image)
+  std::shared_ptr<container> image;
+
+  // directory size (in blocks) from which 'searchDir' builds and uses a hash index (0 = never)
+  // (atomic, the worker threads of batch and tree mode read it while searching)
+  std::atomic<uint32_t> dirIndexThreshold{8};
+
+  // number and size (in bytes) of the ring buffers used by 'extractRuns' for pipelined copies (0 buffers = no pipeline)
+  uint32_t pipelineBufferCount = 0, pipelineBufferSize = 8 << 20;
 
   // the currently opened partition number (0 = no opened partition)
   int openedPartition = 0;
 
   // the currently opened partition start (0 = no opened partition)
-  uint32_t openedPartitionStart = 0;
+  int64_t openedPartitionStart = 0;
 
   // the currently opened partition end (0 = no opened partition)
-  uint32_t openedPartitionEnd = 0;
+  int64_t openedPartitionEnd = 0;
 
-  /* METHODS */
+  // whether the opened partition is stored in one piece and in order in the image file (false = no opened partition
+  // or a sparse image, the cursor cannot read it)
+  bool openedPartitionInOrder = false;
 
-  // sets the values in the header struct
-  void setHeader();
+  // start of the read-only memory mapping of the whole image file (NULL = mmap backend not in use)
+  const char *mappedFile = NULL;
 
-  // sets the values of the partition table
+  // engine for reads that are split up or batched and kept in flight together (NULL = one synchronous read at a time)
+  std::unique_ptr<readEngine> engine;
+
+  /* METHODS */
+
+  // sets the values of the partition table (the 4 MBR entries, or every entry of the GPT on GPT disks)
   void setPartitionTable();
 
+  // read the GPT whose header is at sector 'headerLBA' into the partition table (returns false if there is no valid
+  // GPT header there)
+  bool readGPT(uint64_t headerLBA);
+
+  // opens the filesystem of partition 'filesystemPartition' (reads the superblock and block group descriptors)
+  void openFilesystem();
+
   // sets the values in the superblock struct
   void setSuperblock();
 
-  // get the VDI file's byte location of the desired block number
-  uint32_t locateBlock(uint32_t blockNum) const;
+  // read 'size' bytes starting at byte 'diskPosition' of the virtual disk (not the partition) into buffer
+  // (split into the pieces the container stores contiguously, unallocated pieces read back as zeros without any I/O)
+  void readDisk(char *buffer, uint64_t diskPosition, uint32_t size);
+
+  // get the byte location of the desired block number inside the partition
+  uint64_t locateBlock(uint32_t blockNum) const;
+
+  // get the decoded array of block numbers stored in the indirect block 'blockNum' (read from disk only on a miss)
+  std::shared_ptr<const std::vector<uint32_t>> fetchIndirect(uint32_t blockNum);
+
+  // decode the raw indirect block starting at 'raw' into an array of block numbers
+  std::shared_ptr<const std::vector<uint32_t>> decodeIndirect(const char *raw) const;
+
+  // read the 'count' indirect blocks listed at 'blockNums' into the indirect cache with one batch on the read engine
+  // (zero entries are holes and blocks that are already cached are kept as they are, both are skipped)
+  void prefetchIndirect(const uint32_t *blockNums, size_t count);
+
+  // get the contents of the block indicated by 'blockNum' out of the block cache (read from disk only on a miss)
+  std::shared_ptr<const std::vector<char>> cachedBlock(uint32_t blockNum);
+
+  // get a pointer to 'size' bytes starting at byte 'position' inside the virtual disk
+  // (points straight into the mapping with the mmap backend, otherwise reads into 'buffer' and returns it)
+  // note: ranges inside a single block are served from the block cache
+  const char *view(char *buffer, uint64_t position, uint32_t size);
 
  public:
   /* VARIABLES */
 
-  // structure of the VDI header
-  struct header {
-    uint32_t imageType, offsetBlocks, offsetData, sectorSize, blockSize, blocksInHDD, blocksAllocated;
-    uint64_t diskSize;
-  } header;
+  // structure of a cache's lookup counters
+  struct cacheStats {
+    uint64_t hits, misses;
+  };
+
+  // storage backends the VDI file can be read through
+  // (stream = std::fstream reads, mmap = the whole file is memory-mapped once and read through pointers)
+  enum class ioBackend { stream, mmap };
+
+  // largest block size an ext2 filesystem can have (used to size block buffers on the stack)
+  static const uint32_t maxBlockSize = 65536;
+
+  // largest number of blocks on the way down an HTree index (dx_root, up to two dx_node levels and the leaf)
+  static const uint32_t maxHTreeLevels = 4;
 
   // structure of the disk's partitions
+  // (GPT entries only have the sectors, the type GUID and the name, the MBR fields of those are all zero)
   struct partitionEntry {
-    uint32_t first_LBA_sector, LBA_sector_count;
-    uint8_t status, firstSectorCHS[3], lastSectorCHS[3], type;
-  } partitionTable[4];  // partition table is an array of 4 partition entries
+    uint64_t first_LBA_sector, LBA_sector_count;
+    uint8_t status, firstSectorCHS[3], lastSectorCHS[3], type, typeGUID[16];
+    std::string name;
+  };
+
+  // partition table (partition number - 1 = position, unused entries have a sector count of 0)
+  std::vector<partitionEntry> partitionTable;
+
+  // type of the protective MBR entry that covers a GPT disk
+  static const uint8_t gptProtectiveType = 0xee;
 
   // structure of the disk's superblock
   struct superblock {
     uint32_t inodeCount, blockCount, reservedBlockCount, freeBlockCount, freeInodeCount, firstDataBlock, logBlockSize,
         logFragmentSize, blocksPerGroup, fragmentsPerGroup, inodesPerGroup, firstInodeNumber, blockSize,
-        blockGroupCount;
-    uint16_t magicNumber, state, inodeSize;
+        blockGroupCount, featureCompat, featureIncompat, hashSeed[4], flags;
+    uint16_t magicNumber, state, inodeSize, descSize;
   } superblock;
 
+  // compatible feature flag of filesystems that keep an HTree index in large directories
+  static const uint32_t compatDirIndex = 0x20;
+
+  // incompatible feature flag of filesystems whose HTree indexes can be 3 levels deep instead of 2
+  static const uint32_t incompatLargeDir = 0x4000;
+
+  // superblock flag of filesystems that hash directory names as unsigned chars
+  static const uint32_t unsignedHashFlag = 0x2;
+
+  // incompatible features this reader understands (filetype, needs_recovery, extents, 64bit, mmp, flex_bg, ea_inode,
+  // csum_seed, largedir, casefold)
+  static const uint32_t supportedIncompat = 0x2 | 0x4 | 0x40 | 0x80 | 0x100 | 0x200 | 0x400 | 0x2000 | 0x4000 | 0x20000;
+
+  // incompatible feature flag of filesystems whose journal still holds changes that were never written back (the
+  // metadata read without replaying it can be stale)
+  static const uint32_t incompatRecover = 0x4;
+
+  // incompatible feature flag of filesystems with 64-bit block numbers (and block group descriptors of 'descSize')
+  static const uint32_t incompat64Bit = 0x80;
+
   // structure of the disk's block group descriptor table
   struct blockGroupDescriptorTable {
     uint32_t blockBitmap, inodeBitmap, inodeTable;
-    uint16_t freeBlocksCount, freeInodesCount, usedDirsCount;
+    uint16_t freeBlocksCount, freeInodesCount, usedDirsCount, flags;
   };
 
+  // block group flag of a group whose inode bitmap and inode table were never initialized (no inode in use)
+  static const uint16_t inodeUninit = 0x1;
+
   // pointer to the BGDT array (size dynamically allocated on class construction)
   blockGroupDescriptorTable *bgdt = NULL;
 
   // structure of the disk's inodes
   struct inode {
-    uint32_t size, atime, ctime, mtime, dtime, blocks, flags, block[15], generation, aclBlock;
+    uint64_t size;
+    uint32_t atime, ctime, mtime, dtime, blocks, flags, block[15], generation, aclBlock;
     uint16_t mode, uid, gid, linksCount;
   };
 
+  // structure of every in-use inode of the filesystem, read in one pass (see 'scanInodes')
+  // ('slot' maps an inode number to its position in 'inodes' plus one, 0 = not in use)
+  struct inodeSet {
+    std::vector<uint32_t> slot;
+    std::vector<inode> inodes;
+  };
+
+  // structure of a contiguous run of file blocks
+  // (file blocks 'logical' to 'logical + length' are stored in disk blocks 'physical' onward, physical = 0 is a hole)
+  struct extent {
+    uint32_t logical, physical, length;
+  };
+
+  // inode flag of files whose blocks are mapped by an ext4 extent tree (the block array holds the root node)
+  static const uint32_t extentsFlag = 0x80000;
+
+  // inode flags of directories with an HTree index, and of directories whose names are hashed differently (encrypted
+  // and case-insensitive directories, which are searched without the index)
+  static const uint32_t indexFlag = 0x1000, encryptFlag = 0x800, casefoldFlag = 0x40000000;
+
+  // structure of a decoded ext4 extent tree node ('depth' 0 = leaf)
+  // (leaf entries are runs of the file, uninitialized ones are holes; index entries hold the first file block below
+  // them in 'logical' and the block of the child node in 'physical')
+  struct extentNode {
+    uint16_t depth;
+    std::vector<extent> entries;
+  };
+
   // structure of a directory entry
   struct dirEntry {
     uint32_t iNum;
@@ -90,6 +227,32 @@ class vdi {
     char name[256];
   };
 
+  // structure of a lightweight view of a directory entry
+  // (the name points straight into the directory block and is not null terminated, use 'nameLen')
+  struct dirEntryView {
+    uint32_t iNum;
+    uint8_t fileType, nameLen;
+    const char *name;
+  };
+
+  // structure of a directory iterated one block at a time (owns no memory, see 'openDirStream')
+  struct dirStream {
+    inode in;
+    uint32_t iNum, cursor, loadedBlock;
+    char *buffer;
+    const char *block;
+  };
+
+  // structure of the callbacks of 'visitTree' (each of them may be left empty)
+  // 'preDir' is called when a directory is reached, before its contents (return false to skip them),
+  // 'postDir' after its contents, and 'file' for every entry that is not a directory
+  // ('depth' is 0 for entries of the starting directory, the views are only valid during the call)
+  struct treeVisitor {
+    std::function<bool(const dirEntryView &dir, uint32_t depth)> preDir;
+    std::function<void(const dirEntryView &dir, uint32_t depth)> postDir;
+    std::function<void(const dirEntryView &file, uint32_t depth)> file;
+  };
+
   // structure of a directory
   struct directory {
     inode in;
@@ -103,18 +266,52 @@ class vdi {
 
   /* CONSTRUCTORS */
 
-  // constructor that takes path to VDI file
-  explicit vdi(const char *filePath);
+  // constructor that takes path to VDI file, the storage backend to read it through and the number of the partition
+  // whose filesystem is read (1 based, in the order of the MBR or GPT)
+  explicit vdi(const char *filePath, ioBackend backend = ioBackend::stream, int partition = 1);
+
+  // constructor for a handle on the filesystem of partition 'partition' of the image opened by 'disk'
+  // (shares the opened file, memory mapping and container with it but has its own caches and read engine, so handles
+  // on different partitions can be read from different threads at once)
+  vdi(const vdi &disk, int partition);
+
+  // a handle owns its caches and block group descriptors (use the constructor above for another handle)
+  vdi(const vdi &) = delete;
+  vdi &operator=(const vdi &) = delete;
+
+  /* DESTRUCTOR */
+
+  // releases the block group descriptors and the read engine (the image file is closed by the last handle on it)
+  ~vdi();
 
   /* METHODS */
 
   // read 'size' amount bytes from VDI into buffer (starting at cursor)
+  // note: the cursor based methods (read, seek, partition*) share one file cursor and are not thread-safe
   void read(char *buffer, std::streamsize size);
 
+  // read 'size' amount bytes starting at byte 'position' inside the virtual disk into buffer
+  // note: does not use or move the file cursor, so it is safe to call from multiple threads at once
+  // (every fetch* method is built on this, so one vdi object can be shared by many threads)
+  void readAt(char *buffer, uint64_t position, uint32_t size);
+
+  // run the 'count' reads starting at 'requests' at once through the read engine (see 'setQueueDepth') and block until
+  // every one of them has finished (the positions are bytes inside the virtual disk, like 'readAt')
+  void readBatch(const readEngine::request *requests, size_t count);
+
+  // keep up to 'depth' reads in flight at once (io_uring where the kernel allows it, otherwise worker threads)
+  // note: large reads are split into 'depth' pieces and indirect blocks are prefetched in batches (0 or 1 = one
+  // synchronous read at a time, which is the default, no effect with the mmap backend or on Windows)
+  void setQueueDepth(unsigned depth);
+
   // write 'size' amount bytes from 'buffer' to VDI (starting at cursor)
   // TODO: unused function, commented out for now
   // void write(const char *buffer, std::streamsize size);
 
+  // throws if the opened partition is not stored in one piece and in order in the image file ('action' names the
+  // cursor operation in the error)
+  void checkPartitionInOrder(const char *action) const;
+
   // sets the position of the file cursor to byte 'position' inside the virtual disk
   void seek(std::ios::pos_type position);
 
@@ -130,22 +327,29 @@ class vdi {
   // TODO: unused function, commented out for now
   // static void printBuffer(const char *buffer, uint32_t size);
 
-  // converts the given character buffer from little endian to a single uint64_t ('size' = length of buffer)
-  // note: 'size' should never be greater than 8
-  static uint64_t littleEndianToInt(const char *buffer, uint8_t size);
-
   // converts an int to a hex in little endian format and places the result into a character buffer
   // (buffer size of 4 will hold the full int, less than 4 will truncate)
   // TODO: unused function, commented out for now
   // static void intToLittleEndianHex(char *buffer, uint32_t bufferSize, uint32_t num);
 
-  // open a partition by its number (1-4)
+  // get the number of the partition whose filesystem this handle reads (1 based)
+  int partitionNumber() const;
+
+  // checks if the filesystem was not cleanly unmounted and its journal still has to be replayed (the journal is not
+  // read, so recently changed files may be read from stale metadata)
+  bool needsRecovery() const;
+
+  // describe partition 'number' for error messages (its number with its GPT name and type GUID, or its MBR type)
+  std::string describePartition(int number) const;
+
+  // open a partition by its number (1 based, 1-4 on MBR disks)
   void partitionOpen(int number);
 
   // close the opened partition (only one can be opened at a time)
   void partitionClose();
 
   // read 'size' amount bytes from the opened partition into buffer (starting at cursor)
+  // note: throws on images that do not store the partition in order (qcow2, VMDK, dynamic VDI), use 'readAt' for those
   void partitionRead(char *buffer, std::streamsize size);
 
   // write 'size' amount bytes from 'buffer' to the opened partition (starting at cursor)
@@ -160,8 +364,15 @@ class vdi {
   void partitionSeek(std::ios::off_type offset, std::ios_base::seekdir direction);
 
   // read the block indicated by 'blockNum' into the buffer (buffer must be at least size 'superblock.blockSize')
+  // note: blocks are kept in an LRU block cache, so repeated metadata reads don't go to disk
   void fetchBlock(char *buffer, uint32_t blockNum);
 
+  // set how many blocks the block cache holds at once (0 disables the cache, default is 1024)
+  void setBlockCacheCapacity(size_t capacity);
+
+  // get the hit and miss counts of the block cache
+  cacheStats blockCacheStats() const;
+
   // write the contents of the buffer into the block indicated by 'blockNum'
   // (buffer cannot be bigger than 'superblock.blockSize')
   // TODO: unused function, commented out for now
@@ -182,8 +393,19 @@ class vdi {
   // void writeBGDT(const struct blockGroupDescriptorTable *bgdt, uint32_t blockNum);
 
   // read the inode at the specified inode index into an inode structure
+  // note: on a cache miss every inode in the same inode table block is decoded and cached in one pass
   void fetchInode(struct inode &in, uint32_t iNum);
 
+  // read every in-use inode of the filesystem into 'inodes' with one sequential pass over each block group
+  // (the inode bitmap of a group says which inodes are in use, its inode table is read in large pieces in disk order)
+  void scanInodes(struct inodeSet &inodes);
+
+  // set how many decoded inodes the inode cache holds at once (0 disables the cache, default is 8192)
+  void setInodeCacheCapacity(size_t capacity);
+
+  // get the hit and miss counts of the inode cache
+  cacheStats inodeCacheStats() const;
+
   // write the given inode structure at the specified inode index
   // TODO: unused function, commented out for now
   // void writeInode(const struct inode &in, uint32_t iNum);
@@ -201,7 +423,8 @@ class vdi {
   // void freeInode(uint32_t iNum);
 
   // read the file block 'bNum' into a buffer of the file represented by the supplied inode
-  // (buffer must be at least size 'superblock.blockSize')
+  // (buffer must be at least size 'superblock.blockSize', holes are filled with zeros without reading anything)
+  // note: indirect blocks are cached, so sequential calls read each SIB/DIB/TIB from disk only once
   void fetchBlockFromFile(char *buffer, const struct inode &in, uint32_t bNum);
 
   // write the supplied buffer into the file block 'bNum' of the file represented by the supplied inode
@@ -209,6 +432,33 @@ class vdi {
   // TODO: unused function, commented out for now
   // void writeBlockToFile(const char *buffer, struct inode &in, uint32_t bNum);
 
+  // set how many decoded indirect blocks are cached at once (0 disables the cache, default is 64)
+  void setIndirectCacheCapacity(size_t capacity);
+
+  // set how many decoded extent tree nodes are cached at once (0 disables the cache, default is 64)
+  void setExtentCacheCapacity(size_t capacity);
+
+  // resolve the block tree of the file represented by the supplied inode into a list of contiguous runs
+  // (in logical order, only covering the blocks within the file's size)
+  std::vector<extent> mapFile(const struct inode &in);
+
+  // copy the whole file represented by the supplied inode to 'hostPath' on the host system
+  // (each physically contiguous run is copied by the kernel where possible, otherwise with a single large read)
+  void extractFile(const struct inode &in, const char *hostPath);
+
+  // copy a file of 'size' bytes made up of the 'count' runs starting at 'runs' to 'hostPath' on the host system
+  // (the runs must come from 'mapFile', or from a path index built with it)
+  void extractRuns(const struct extent *runs, size_t count, uint64_t size, const char *hostPath);
+
+  // make 'extractRuns' copy through a ring of 'bufferCount' aligned buffers of 'bufferSize' bytes each, filled by the
+  // calling thread and written out by a second thread at the same time (0 buffers goes back to the kernel side copy)
+  // note: worth it when the VDI file and the output are on different devices (POSIX only, ignored on Windows)
+  void setExtractPipeline(uint32_t bufferCount, uint32_t bufferSize);
+
+  // get the disk block number that holds the file block 'bNum' of the file represented by the supplied inode
+  // note: returns 0 if the block is a hole (a zero entry in the block array or in any indirect block above it)
+  uint32_t locateFileBlock(const struct inode &in, uint32_t bNum);
+
   // open the directory with the given inode number and return a pointer to the directory struct
   struct directory *openDir(uint32_t iNum);
 
@@ -224,19 +474,178 @@ class vdi {
   // close the directory and deallocate the directory pointer
   void closeDir(struct directory *d);
 
+  // start iterating the directory with inode number 'iNum' without allocating anything
+  // ('buffer' must be at least size 'superblock.blockSize', it is unused with the mmap backend)
+  void openDirStream(struct dirStream &ds, uint32_t iNum, char *buffer);
+
+  // get the next entry of the directory as a view into its block (each block is loaded only once)
+  // note: unused entries (inode 0) are skipped, the view is only valid until the next call
+  // returns true on success, false if it hit the end of the directory
+  bool nextDirEntry(struct dirStream &ds, struct dirEntryView &entry);
+
   // searches a directory with inode 'iNum' for the target file 'target' and returns the inode number of the file
   // note: returns 0 if a file is not found
+  // note: results (including misses) are kept in the dentry cache
   uint32_t searchDir(uint32_t iNum, char *target);
 
+  // set how many directory entry lookups the dentry cache holds at once (0 disables the cache, default is 16384)
+  void setDentryCacheCapacity(size_t capacity);
+
+  // get the hit and miss counts of the dentry cache
+  cacheStats dentryCacheStats() const;
+
+  // set the directory size (in blocks) from which 'searchDir' builds and uses a hash index (0 disables indexing)
+  // note: the index is built on the first lookup in a directory, after that lookups in it are O(1)
+  // (default is 8 blocks, the indexes of the 64 most recently used large directories are kept)
+  void setDirIndexThreshold(uint32_t blocks);
+
   // takes a full file path and returns the inode number of the file
   uint32_t traversePath(char *path);
 
   // print the info of a file at the current 'directory entry' stored in directory 'd'
   void printFileInfo(struct directory *d);
 
+  // print the info of the file the directory entry view 'entry' points to
+  void printFileInfo(const struct dirEntryView &entry);
+
+  // append the line 'printFileInfo' prints for the directory entry view 'entry' to 'out'
+  void formatFileInfo(const struct dirEntryView &entry, std::string &out);
+
+  // same as above, but with the entry's inode 'i' already read
+  void formatFileInfo(const struct dirEntryView &entry, const struct inode &i, std::string &out);
+
+  // calls the callbacks of 'visitor' for every entry below the directory at inode 'iNum' (except . and ..), depth first
+  // note: no recursion, the walk keeps 8 bytes per directory level and a single block buffer however deep the tree is
+  // (a directory is re-read from its inode when the walk comes back up to it, usually from the caches)
+  void visitTree(uint32_t iNum, const treeVisitor &visitor);
+
   // prints all files and directories inside the VDI file starting at inode 'iNum' and goes to the end of the disk
   // note: iNum of 2 lists all files/folders inside the VDI file
   void printAllFiles(uint32_t iNum);
+
+  // same as above, but the inodes come from 'inodes' (filled by 'scanInodes') instead of one lookup per entry
+  void printAllFiles(uint32_t iNum, const struct inodeSet &inodes);
+
+  // same as above, but the directories are read by 'threadCount' worker threads (0 = one per hardware thread)
+  // note: the output is exactly the same as the single threaded version
+  void printAllFiles(uint32_t iNum, unsigned threadCount);
+
+  // calls 'visit' for every entry below the directory at inode 'iNum' (except . and ..) and writes everything the
+  // calls append to their string to 'out', in the same depth first order as a single threaded walk
+  // (each directory is read by its own task on 'pool', so 'visit' is called from many threads at once)
+  void walkTree(uint32_t iNum, threadPool &pool, const std::function<void(const dirEntryView &, std::string &)> &visit,
+                std::ostream &out);
+
+ private:
+  /* VARIABLES (declared after the public structures they use) */
+
+  // decoded indirect blocks (SIB/DIB/TIB block number -> array of block numbers), shared by all files
+  lruCache<uint32_t, std::shared_ptr<const std::vector<uint32_t>>> indirectCache{64};
+
+  // decoded extent tree nodes below the root (block number -> node), shared by all files
+  lruCache<uint32_t, std::shared_ptr<const extentNode>> extentCache{64};
+
+  // raw blocks read by 'fetchBlock' and 'view' (block number -> block contents, unused with the mmap backend)
+  lruCache<uint32_t, std::shared_ptr<const std::vector<char>>> blockCache{1024};
+
+  // decoded inodes (inode number -> inode), filled one whole inode table block at a time
+  lruCache<uint32_t, inode> inodeCache{8192};
+
+  // directory entry lookups ('dentryKey' of parent inode and name -> child inode, 0 = known to not exist)
+  lruCache<std::string, uint32_t> dentryCache{16384};
+
+  // hash indexes of large directories (directory inode number -> (name -> inode number))
+  lruCache<uint32_t, std::shared_ptr<const std::unordered_map<std::string, uint32_t>>> dirIndexCache{64};
+
+  /* METHODS (declared after the public structures they use) */
+
+  // structure of the output of one directory in 'walkTree': pieces of text, each followed by the output of a
+  // subdirectory (NULL after the last piece)
+  struct walkSegment {
+    std::vector<std::pair<std::string, std::unique_ptr<walkSegment>>> parts;
+  };
+
+  // 'walkTree' task that reads the directory at inode 'iNum' into 'segment', queueing a task for every subdirectory
+  void walkDir(uint32_t iNum, walkSegment *segment, threadPool &pool,
+               const std::function<void(const dirEntryView &, std::string &)> &visit);
+
+  // look up the name 'target' (of length 'targetLen') through the HTree index of the directory opened in 'ds'
+  // (hashes the name and follows the dx_root and dx_node blocks down to the one leaf block that can hold it)
+  // returns true on success with the inode number in 'found' (0 = not in the directory), false if the directory has no
+  // usable index and has to be searched linearly
+  // ('buffers' must be at least size 'maxHTreeLevels * maxBlockSize', it is unused with the mmap backend)
+  bool searchHTree(struct dirStream &ds, const char *target, size_t targetLen, uint32_t &found, char *buffers);
+
+  // get the hash index (name -> inode number) of the directory opened in 'ds', building it on the first call
+  // note: 'ds' must not have been iterated yet
+  std::shared_ptr<const std::unordered_map<std::string, uint32_t>> fetchDirIndex(struct dirStream &ds);
+
+  // build the dentry cache key of the entry named 'name' (of length 'nameLen') inside the directory with inode 'parent'
+  static std::string dentryKey(uint32_t parent, const char *name, size_t nameLen);
+
+  // decode the raw on-disk inode starting at 'raw' into an inode structure
+  static void decodeInode(const char *raw, struct inode &in);
+
+  // get the record length of the raw directory entry starting at 'raw' (on 64K block filesystems a whole block is
+  // stored as 65535 or 0 and the two low bits hold bit 16 and 17 of the length)
+  uint32_t decodeRecLen(const char *raw) const;
+
+  // add the file blocks 'logical' onward stored at disk block 'physical' onward to the end of the run list
+  // (extends the last run when both are contiguous, a physical block of 0 is a hole)
+  static void appendRun(std::vector<extent> &runs, uint32_t logical, uint32_t physical, uint32_t length);
+
+  // resolve the indirect block 'blockNum' of depth 'depth' (1 = SIB, 2 = DIB, 3 = TIB) into the run list
+  // ('logical' is the first file block it covers and is moved past it, 'remaining' is the number of file blocks left)
+  void mapIndirect(std::vector<extent> &runs, uint32_t blockNum, int depth, uint32_t &logical, uint32_t &remaining);
+
+  // decode the root node of the extent tree stored in the block array of the supplied inode
+  std::shared_ptr<const extentNode> rootExtentNode(const struct inode &in) const;
+
+  // copy the raw root node of the extent tree out of the block array of the supplied inode into 'raw' (60 bytes)
+  static void packExtentRoot(const struct inode &in, char *raw);
+
+  // get the decoded extent tree node stored in block 'blockNum', which has to be at depth 'depth' of its tree
+  // (read from disk only on a miss)
+  std::shared_ptr<const extentNode> fetchExtentNode(uint32_t blockNum, uint16_t depth);
+
+  // decode the raw extent tree node of 'size' bytes starting at 'raw' (a header followed by index or leaf entries)
+  std::shared_ptr<const extentNode> decodeExtentNode(const char *raw, uint32_t size) const;
+
+  // check the header of the raw extent tree node of 'size' bytes starting at 'raw' and get its number of entries
+  static uint16_t checkExtentHeader(const char *raw, uint32_t size);
+
+  // decode the raw 12-byte entry starting at 'raw' of an extent tree node at depth 'depth' into 'decoded'
+  static void decodeExtentEntry(const char *raw, uint16_t depth, struct extent &decoded);
+
+  // read the nodes the 'count' index entries starting at 'entries' point to into the extent cache with one batch on
+  // the read engine (nodes that are already cached are kept as they are and skipped)
+  void prefetchExtentNodes(const struct extent *entries, size_t count);
+
+  // resolve the extent tree node 'node' and everything below it into the run list (gaps between extents become holes)
+  // ('logical' is the next file block to be mapped and is moved past the node, 'remaining' is the number of file
+  // blocks left)
+  void mapExtents(std::vector<extent> &runs, const struct extentNode &node, uint32_t &logical, uint32_t &remaining);
+
+#ifndef _WIN32
+  // copy the 'size' bytes of the virtual disk starting at byte 'position' to the current offset of the descriptor 'out'
+  // ('hostPath' is the file 'out' was opened from, only used in error messages)
+  // note: unallocated pieces of the image are skipped over as holes (the caller sets the final file size)
+  void copyRun(int out, const char *hostPath, uint64_t position, uint64_t size, std::vector<char> &buffer);
+
+  // copy the 'size' bytes of the VDI file starting at byte 'position' to the current offset of the descriptor 'out'
+  // ('hostPath' is the file 'out' was opened from, only used in error messages)
+  // note: tries 'copy_file_range' (kernel side copy, reflinks where supported) then 'sendfile', and only reads the data
+  // through 'buffer' when neither works between the two files
+  void copyFileRange(int out, const char *hostPath, uint64_t position, uint32_t size, std::vector<char> &buffer);
+
+  // write all 'size' bytes of 'buffer' to the descriptor 'out' at byte 'position' (or at its current offset when
+  // 'position' is -1, 'hostPath' is only used in the error message)
+  static void writeAll(int out, const char *buffer, size_t size, int64_t position, const char *hostPath);
+
+  // copy the data runs of a file of 'size' bytes made up of the 'count' runs starting at 'runs' to the descriptor 'out'
+  // through the ring buffers set with 'setExtractPipeline' (holes are left unwritten)
+  void pipeRuns(int out, const char *hostPath, const struct extent *runs, size_t count, uint64_t size);
+#endif
 };
 
 #endif  // OS_TERM_PROJECT_VDI_H
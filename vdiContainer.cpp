@@ -0,0 +1,134 @@
+//
+// Implementation of the VDI container class (VirtualBox disk images, fixed and dynamic)
+//
+
+#include "vdiContainer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "byteOrder.h"
+
+// constructor that takes the reader for the image file and its size in bytes (reads the header and block map)
+vdiContainer::vdiContainer(fileReader reader, uint64_t fileSize) : container(std::move(reader), fileSize) {
+  // fill out the header struct with the opened file
+  setHeader();
+
+  // load the block allocation map of a dynamic image (every disk read is translated through it)
+  setBlockMap();
+
+  diskBytes = header.diskSize;
+  sectorBytes = header.sectorSize;
+}
+
+// sets the values in the header struct
+void vdiContainer::setHeader() {
+  // the whole raw header (the fields used here all sit in the first 0x190 bytes)
+  char buffer[0x190];
+  readFile(buffer, 0, sizeof(buffer));
+
+  // get image type (1 = dynamic, 2 = static, 3 = undo, 4 = differencing)
+  header.imageType = littleEndianToInt(buffer + 0x4c, 4);
+
+  // get offset blocks
+  header.offsetBlocks = littleEndianToInt(buffer + 0x154, 4);
+
+  // get offset data
+  header.offsetData = littleEndianToInt(buffer + 0x158, 4);
+
+  // get sector size
+  header.sectorSize = littleEndianToInt(buffer + 0x168, 4);
+
+  // get disk size
+  header.diskSize = littleEndianToInt(buffer + 0x170, 8);
+
+  // get block size
+  header.blockSize = littleEndianToInt(buffer + 0x178, 4);
+
+  // get size of the extra data stored in front of every block
+  header.blockExtra = littleEndianToInt(buffer + 0x17c, 4);
+
+  // get blocks in HDD
+  header.blocksInHDD = littleEndianToInt(buffer + 0x180, 4);
+
+  // get blocks allocated
+  header.blocksAllocated = littleEndianToInt(buffer + 0x184, 4);
+
+  if (header.sectorSize == 0) {
+    throw std::runtime_error("invalid VDI header (sector size is zero)");
+  }
+
+  // undo and differencing images only hold the blocks that differ from a parent image
+  if (header.imageType != 1 && header.imageType != 2) {
+    throw std::runtime_error("unsupported VDI image type: " + std::to_string(header.imageType) +
+                             " (only dynamic and fixed images can be read)");
+  }
+
+  // the block positions are computed without room for extra data in front of each block
+  if (header.blockExtra != 0) {
+    throw std::runtime_error("unsupported VDI image (" + std::to_string(header.blockExtra) +
+                             " bytes of extra data per block)");
+  }
+}
+
+// loads the block allocation map of a dynamic image into 'blockMap' (left empty for fixed images)
+void vdiContainer::setBlockMap() {
+  // fixed images store the whole disk in order, nothing to translate
+  if (header.imageType != 1) {
+    return;
+  }
+
+  if (header.blockSize == 0 || (uint64_t)header.blocksInHDD * header.blockSize < header.diskSize) {
+    throw std::runtime_error("invalid dynamic VDI header (the blocks do not cover the disk)");
+  }
+
+  // one little endian entry per VDI block, read in a single pass
+  std::vector<char> raw((size_t)header.blocksInHDD * 4);
+  readFile(raw.data(), header.offsetBlocks, raw.size());
+
+  blockMap.resize(header.blocksInHDD);
+  for (uint32_t i = 0; i < header.blocksInHDD; ++i) {
+    blockMap[i] = littleEndianToInt(raw.data() + (size_t)i * 4, 4);
+  }
+}
+
+// find where byte 'diskPosition' of the virtual disk is stored in the image file
+// (runs of VDI blocks that follow each other in the file are returned as one piece)
+bool vdiContainer::locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) {
+  checkRange(diskPosition, length);
+
+  // fixed images store the whole disk as is
+  if (blockMap.empty()) {
+    filePosition = header.offsetData + diskPosition;
+    checkFileRange(filePosition, length);
+    return true;
+  }
+
+  uint64_t vdiBlock = diskPosition / header.blockSize;
+  uint32_t offset = diskPosition % header.blockSize;
+  bool allocated = blockMap[vdiBlock] < unallocatedBlock;
+
+  // extend the piece over the following blocks while they are stored right after this one (or are also unallocated)
+  uint64_t span = header.blockSize - offset;
+  for (uint64_t next = vdiBlock + 1; span < length && next < blockMap.size(); ++next, span += header.blockSize) {
+    bool nextAllocated = blockMap[next] < unallocatedBlock;
+    if (nextAllocated != allocated || (allocated && blockMap[next] != blockMap[vdiBlock] + (next - vdiBlock))) {
+      break;
+    }
+  }
+  length = std::min((uint64_t)length, span);
+
+  // free and zeroed blocks have no data in the file
+  if (!allocated) {
+    return false;
+  }
+
+  filePosition = header.offsetData + (uint64_t)blockMap[vdiBlock] * header.blockSize + offset;
+  checkFileRange(filePosition, length);
+  return true;
+}
+
+// get the name of the image format
+const char *vdiContainer::format() const { return "VDI"; }
@@ -0,0 +1,57 @@
+//
+// Header for the VDI container class (VirtualBox disk images, fixed and dynamic)
+//
+
+#ifndef OS_TERM_PROJECT_VDICONTAINER_H
+#define OS_TERM_PROJECT_VDICONTAINER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "container.h"
+
+class vdiContainer : public container {
+ public:
+  /* VARIABLES */
+
+  // structure of the VDI header
+  struct header {
+    uint32_t imageType, offsetBlocks, offsetData, sectorSize, blockSize, blockExtra, blocksInHDD, blocksAllocated;
+    uint64_t diskSize;
+  } header;
+
+ private:
+  /* VARIABLES */
+
+  // block allocation map of a dynamic image (VDI block number -> index of the block in the data area, empty = fixed
+  // image that stores the whole disk as is)
+  std::vector<uint32_t> blockMap;
+
+  // block map entries from this value up mark blocks that are not stored in the file (free or zeroed)
+  static const uint32_t unallocatedBlock = 0xFFFFFFFE;
+
+  /* METHODS */
+
+  // sets the values in the header struct
+  void setHeader();
+
+  // loads the block allocation map of a dynamic image into 'blockMap' (left empty for fixed images)
+  void setBlockMap();
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the reader for the image file and its size in bytes (reads the header and block map)
+  vdiContainer(fileReader reader, uint64_t fileSize);
+
+  /* METHODS */
+
+  // find where byte 'diskPosition' of the virtual disk is stored in the image file
+  // (runs of VDI blocks that follow each other in the file are returned as one piece)
+  bool locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) override;
+
+  // get the name of the image format
+  const char *format() const override;
+};
+
+#endif  // OS_TERM_PROJECT_VDICONTAINER_H
@@ -0,0 +1,129 @@
+//
+// Implementation of the VMDK container class (VMware monolithic sparse disk images)
+//
+
+#include "vmdkContainer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "byteOrder.h"
+
+// constructor that takes the reader for the image file and its size in bytes (reads the header and grain directory)
+vmdkContainer::vmdkContainer(fileReader reader, uint64_t fileSize) : container(std::move(reader), fileSize) {
+  setHeader();
+  diskBytes = header.capacity * 512;
+}
+
+// sets the values in the header struct and loads the grain directory
+void vmdkContainer::setHeader() {
+  // the raw sparse extent header
+  char buffer[80];
+  readFile(buffer, 0, sizeof(buffer));
+
+  // get version
+  header.version = littleEndianToInt(buffer + 4, 4);
+
+  // get flags
+  header.flags = littleEndianToInt(buffer + 8, 4);
+
+  // get capacity (size of the virtual disk)
+  header.capacity = littleEndianToInt(buffer + 12, 8);
+
+  // get grain size
+  header.grainSize = littleEndianToInt(buffer + 20, 8);
+
+  // get number of entries in a grain table
+  header.numGTEsPerGT = littleEndianToInt(buffer + 44, 4);
+
+  // get grain directory offset
+  header.gdOffset = littleEndianToInt(buffer + 56, 8);
+
+  // stream optimized images compress every grain (and may keep the grain directory at the end of the file)
+  if (header.flags & (1 << 16)) {
+    throw std::runtime_error("compressed (stream optimized) VMDK images are not supported");
+  }
+  if (header.grainSize < 8 || (header.grainSize & (header.grainSize - 1)) != 0 || header.numGTEsPerGT == 0) {
+    throw std::runtime_error("invalid VMDK header (grain size or grain table size out of range)");
+  }
+
+  grainBytes = header.grainSize * 512;
+
+  // one grain directory entry per grain table
+  uint64_t grains = (header.capacity + header.grainSize - 1) / header.grainSize;
+  uint64_t tables = (grains + header.numGTEsPerGT - 1) / header.numGTEsPerGT;
+
+  // load the whole grain directory in a single read (little endian 4-byte entries)
+  std::vector<char> raw(tables * 4);
+  readFile(raw.data(), header.gdOffset * 512, raw.size());
+
+  grainDirectory.resize(tables);
+  for (uint64_t i = 0; i < tables; ++i) {
+    grainDirectory[i] = littleEndianToInt(raw.data() + i * 4, 4);
+  }
+}
+
+// get the grain table stored at sector 'sector' of the image file out of the cache (read from disk only on a miss)
+std::shared_ptr<const std::vector<uint32_t>> vmdkContainer::fetchGrainTable(uint32_t sector) {
+  std::shared_ptr<const std::vector<uint32_t>> table;
+
+  // table was read before
+  if (tableCache.get(sector, table)) {
+    return table;
+  }
+
+  // read the whole table and decode its entries
+  std::vector<char> raw((size_t)header.numGTEsPerGT * 4);
+  readFile(raw.data(), (uint64_t)sector * 512, raw.size());
+
+  auto entries = std::make_shared<std::vector<uint32_t>>(header.numGTEsPerGT);
+  for (uint32_t i = 0; i < header.numGTEsPerGT; ++i) {
+    (*entries)[i] = littleEndianToInt(raw.data() + (size_t)i * 4, 4);
+  }
+  tableCache.put(sector, entries);
+
+  return entries;
+}
+
+// find where byte 'diskPosition' of the virtual disk is stored in the image file
+// (runs of grains under one grain table that follow each other in the file are returned as one piece)
+bool vmdkContainer::locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) {
+  checkRange(diskPosition, length);
+
+  uint64_t grain = diskPosition / grainBytes;
+  uint64_t offset = diskPosition % grainBytes;
+  uint64_t tableIndex = grain % header.numGTEsPerGT;
+
+  // no grain table, nothing under it was ever written
+  uint32_t tableSector = grainDirectory[grain / header.numGTEsPerGT];
+  if (tableSector == 0) {
+    length = std::min((uint64_t)length, (header.numGTEsPerGT - tableIndex) * grainBytes - offset);
+    return false;
+  }
+
+  // grain table entries hold the sector of the grain (0 = unallocated, 1 = zeroed grain)
+  std::shared_ptr<const std::vector<uint32_t>> table = fetchGrainTable(tableSector);
+  uint32_t first = (*table)[tableIndex] > 1 ? (*table)[tableIndex] : 0;
+
+  // extend the piece over the following grains while they are stored right after this one (or are also unallocated)
+  uint64_t span = grainBytes - offset;
+  for (uint64_t next = tableIndex + 1; span < length && next < header.numGTEsPerGT; ++next, span += grainBytes) {
+    uint32_t nextSector = (*table)[next] > 1 ? (*table)[next] : 0;
+    if (first == 0 ? nextSector != 0 : nextSector != first + (next - tableIndex) * header.grainSize) {
+      break;
+    }
+  }
+  length = std::min((uint64_t)length, span);
+
+  if (first == 0) {
+    return false;
+  }
+
+  filePosition = (uint64_t)first * 512 + offset;
+  checkFileRange(filePosition, length);
+  return true;
+}
+
+// get the name of the image format
+const char *vmdkContainer::format() const { return "VMDK"; }
@@ -0,0 +1,61 @@
+//
+// Header for the VMDK container class (VMware monolithic sparse disk images)
+//
+
+#ifndef OS_TERM_PROJECT_VMDKCONTAINER_H
+#define OS_TERM_PROJECT_VMDKCONTAINER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "container.h"
+#include "lruCache.h"
+
+class vmdkContainer : public container {
+ public:
+  /* VARIABLES */
+
+  // structure of the sparse extent header (the fields needed to read the image, sizes and offsets in sectors)
+  struct header {
+    uint32_t version, flags, numGTEsPerGT;
+    uint64_t capacity, grainSize, gdOffset;
+  } header;
+
+ private:
+  /* VARIABLES */
+
+  // size of a grain in bytes
+  uint64_t grainBytes = 0;
+
+  // the grain directory (sector offsets of the grain tables, 0 = every grain under that table is unallocated)
+  std::vector<uint32_t> grainDirectory;
+
+  // recently used grain tables, keyed by their sector offset (loaded on first use)
+  lruCache<uint32_t, std::shared_ptr<const std::vector<uint32_t>>> tableCache{256};
+
+  /* METHODS */
+
+  // sets the values in the header struct and loads the grain directory
+  void setHeader();
+
+  // get the grain table stored at sector 'sector' of the image file out of the cache (read from disk only on a miss)
+  std::shared_ptr<const std::vector<uint32_t>> fetchGrainTable(uint32_t sector);
+
+ public:
+  /* CONSTRUCTORS */
+
+  // constructor that takes the reader for the image file and its size in bytes (reads the header and grain directory)
+  vmdkContainer(fileReader reader, uint64_t fileSize);
+
+  /* METHODS */
+
+  // find where byte 'diskPosition' of the virtual disk is stored in the image file
+  // (runs of grains under one grain table that follow each other in the file are returned as one piece)
+  bool locate(uint64_t diskPosition, uint32_t &length, uint64_t &filePosition) override;
+
+  // get the name of the image format
+  const char *format() const override;
+};
+
+#endif  // OS_TERM_PROJECT_VMDKCONTAINER_H